@@ -0,0 +1,64 @@
+#include "ball_grid.h"
+
+#include <algorithm>
+#include <bit>
+
+std::size_t BallGrid::Insert(Cell cell) {
+  for (std::size_t i = Hash(cell);; i = (i + 1) & mask_) {
+    if (table_[i].slot == -1) {
+      table_[i] = Entry{.cell = cell, .slot = int(cells_.size())};
+      cells_.push_back(cell);
+      return i;
+    }
+    if (table_[i].cell == cell) return i;
+  }
+}
+
+void BallGrid::Build(BallStore& balls, std::span<const int> order) {
+  // Size the table so that it stays at most half full.
+  const int n = balls.size();
+  const std::size_t capacity = std::bit_ceil(std::size_t(2 * n + 2));
+  table_.assign(capacity, Entry{});
+  mask_ = capacity - 1;
+  shift_ = 64 - std::countr_zero(capacity);
+  cells_.clear();
+
+  // Find the occupied cells and assign them slots in row-major order.
+  keys_.resize(n);
+  for (int i = 0; i < n; i++) keys_[i] = Insert(CellAt(balls.position(i)));
+  std::sort(cells_.begin(), cells_.end(), [](Cell a, Cell b) {
+    return a.y < b.y || (a.y == b.y && a.x < b.x);
+  });
+  const int num_cells = cells_.size();
+  for (int slot = 0; slot < num_cells; slot++) {
+    for (std::size_t i = Hash(cells_[slot]);; i = (i + 1) & mask_) {
+      if (table_[i].cell == cells_[slot]) {
+        table_[i].slot = slot;
+        break;
+      }
+    }
+  }
+
+  // Counting sort the balls by slot.
+  starts_.assign(num_cells + 1, 0);
+  for (int key : keys_) starts_[table_[key].slot + 1]++;
+  for (int slot = 0; slot < num_cells; slot++) {
+    starts_[slot + 1] += starts_[slot];
+  }
+  cursors_.assign(starts_.begin(), starts_.end() - 1);
+  sorted_.resize(n);
+  for (int i : order) sorted_[cursors_[table_[keys_[i]].slot]++] = i;
+  balls.Reorder(sorted_);
+}
+
+BallGrid::Range BallGrid::FindRow(int y, int x_min, int x_max) const {
+  int first = -1, last = -1;
+  for (int x = x_min; x <= x_max; x++) {
+    const int slot = Find(Cell{.x = x, .y = y});
+    if (slot == -1) continue;
+    if (first == -1) first = slot;
+    last = slot;
+  }
+  if (first == -1) return Range{0, 0};
+  return Range{starts_[first], starts_[last + 1]};
+}
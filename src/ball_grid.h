@@ -0,0 +1,86 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "ball_store.h"
+
+// An unbounded uniform grid over the balls, stored in compressed sparse row
+// form. Build() sorts the balls by cell, after which each occupied cell has a
+// slot and the balls in the cell for slot s are those in [begin(s), end(s)).
+// Slots are numbered in row-major order of their cells. Occupied cells are
+// found through an open addressing hash table, so both memory and time are
+// proportional to the number of balls regardless of how far apart they are.
+class BallGrid {
+ public:
+  // Cell (x, y) covers positions in [x, x + 1) * cell_size horizontally, and
+  // likewise vertically.
+  struct Cell {
+    int x, y;
+    bool operator==(const Cell&) const = default;
+  };
+
+  explicit BallGrid(float cell_size) : cell_size_(cell_size) {}
+
+  Cell CellAt(glm::vec2 position) const {
+    return Cell{.x = int(std::floor(position.x / cell_size_)),
+                .y = int(std::floor(position.y / cell_size_))};
+  }
+
+  // Sorts the balls by cell. Within each cell, the balls keep the relative
+  // order given by order, which must be a permutation of [0, balls.size()).
+  void Build(BallStore& balls, std::span<const int> order);
+
+  int num_cells() const { return cells_.size(); }
+  Cell cell(int slot) const { return cells_[slot]; }
+  int begin(int slot) const { return starts_[slot]; }
+  int end(int slot) const { return starts_[slot + 1]; }
+
+  // Returns the slot for the given cell, or -1 if it is empty.
+  int Find(Cell cell) const {
+    if (table_.empty()) return -1;
+    for (std::size_t i = Hash(cell);; i = (i + 1) & mask_) {
+      if (table_[i].slot == -1 || table_[i].cell == cell) return table_[i].slot;
+    }
+  }
+
+  struct Range { int begin, end; };
+  // Returns the balls in cells x_min to x_max of row y. Since slots are in
+  // row-major order, these are contiguous.
+  Range FindRow(int y, int x_min, int x_max) const;
+
+ private:
+  struct Entry {
+    Cell cell;
+    int slot = -1;  // -1 if the entry is unused.
+  };
+
+  std::size_t Hash(Cell cell) const {
+    const std::uint64_t key =
+        std::uint64_t(std::uint32_t(cell.x)) << 32 | std::uint32_t(cell.y);
+    return (key * 0x9E3779B97F4A7C15) >> shift_;
+  }
+
+  // Returns the table index for the cell, inserting it if it is absent.
+  std::size_t Insert(Cell cell);
+
+  const float cell_size_;
+
+  // The hash table from cells to slots. Its size is a power of two which is
+  // at least twice the number of balls.
+  std::vector<Entry> table_;
+  std::size_t mask_ = 0;
+  int shift_ = 64;
+
+  // For each slot, its cell.
+  std::vector<Cell> cells_;
+  // For each slot, the index of its first ball, plus the total at the end.
+  std::vector<int> starts_;
+
+  // Scratch space for Build().
+  std::vector<int> keys_, cursors_, sorted_;
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <new>
+#include <span>
+#include <vector>
+
+struct Ball {
+  glm::vec2 position;
+  glm::vec2 velocity;
+};
+
+// Ball arrays are aligned, and always extend at least kBallLanes - 1 elements
+// past the last ball, so that kernels can load whole vectors of kBallLanes
+// floats starting at any ball.
+constexpr int kBallLanes = 8;
+constexpr std::size_t kBallAlignment = kBallLanes * sizeof(float);
+
+template <typename T, std::size_t kAlignment>
+struct AlignedAllocator {
+  using value_type = T;
+  template <typename U>
+  struct rebind {
+    using other = AlignedAllocator<U, kAlignment>;
+  };
+
+  AlignedAllocator() = default;
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, kAlignment>&) {}
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(
+        ::operator new(n * sizeof(T), std::align_val_t(kAlignment)));
+  }
+  void deallocate(T* p, std::size_t) {
+    ::operator delete(p, std::align_val_t(kAlignment));
+  }
+
+  bool operator==(const AlignedAllocator&) const = default;
+};
+
+// Ball state stored as a structure of arrays, with one array per component.
+// The order of the balls is not significant: removing a ball moves the last
+// ball into its place. Alongside the current state, each ball also has a
+// previous position, which is kept in step with the ball as it moves between
+// indices so that the two can be interpolated, and a rest position and an
+// integer tag which the owner of the store may use for its own bookkeeping.
+class BallStore {
+ public:
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  Ball operator[](int i) const {
+    return Ball{.position = glm::vec2(x_[i], y_[i]),
+                .velocity = glm::vec2(vx_[i], vy_[i])};
+  }
+  glm::vec2 position(int i) const { return glm::vec2(x_[i], y_[i]); }
+  glm::vec2 previous_position(int i) const {
+    return glm::vec2(previous_x_[i], previous_y_[i]);
+  }
+  glm::vec2 rest_position(int i) const {
+    return glm::vec2(rest_x_[i], rest_y_[i]);
+  }
+  void set_rest_position(int i, glm::vec2 position) {
+    rest_x_[i] = position.x;
+    rest_y_[i] = position.y;
+  }
+  int tag(int i) const { return tags_[i]; }
+  void set_tag(int i, int tag) { tags_[i] = tag; }
+
+  void Set(int i, const Ball& ball) {
+    x_[i] = ball.position.x;
+    y_[i] = ball.position.y;
+    vx_[i] = ball.velocity.x;
+    vy_[i] = ball.velocity.y;
+  }
+
+  // Makes room for n balls, along with the padding after the last one, so
+  // that adding balls up to n does not allocate.
+  void reserve(int n) {
+    if (const int needed = n + kBallLanes - 1; int(x_.size()) < needed) {
+      const int padded = (needed + kBallLanes - 1) / kBallLanes * kBallLanes;
+      for (Array* array : arrays()) array->resize(padded);
+      tags_.resize(padded);
+    }
+  }
+
+  void push_back(const Ball& ball) {
+    reserve(size_ + 1);
+    previous_x_[size_] = ball.position.x;
+    previous_y_[size_] = ball.position.y;
+    set_rest_position(size_, ball.position);
+    tags_[size_] = 0;
+    Set(size_++, ball);
+  }
+
+  // Removes ball i by moving the last ball into its place.
+  void Remove(int i) {
+    size_--;
+    for (Array* array : arrays()) {
+      (*array)[i] = (*array)[size_];
+      (*array)[size_] = 0;
+    }
+    tags_[i] = tags_[size_];
+    tags_[size_] = 0;
+  }
+
+  // Resizes the store to n balls. Any new balls are zero in every component,
+  // including their tags.
+  void resize(int n) {
+    reserve(n);
+    for (Array* array : arrays()) {
+      std::fill(array->begin() + std::min(n, size_),
+                array->begin() + std::max(n, size_), 0.0f);
+    }
+    std::fill(tags_.begin() + std::min(n, size_),
+              tags_.begin() + std::max(n, size_), 0);
+    size_ = n;
+  }
+
+  // Records the current position of every ball as its previous position.
+  void SavePositions() {
+    std::copy_n(x_.begin(), size_, previous_x_.begin());
+    std::copy_n(y_.begin(), size_, previous_y_.begin());
+  }
+
+  // Rearranges the balls so that ball i is the ball which was previously at
+  // index order[i]. order must be a permutation of [0, size()).
+  void Reorder(std::span<const int> order) {
+    for (Array* array : arrays()) {
+      scratch_.resize(array->size());
+      for (int i = 0; i < size_; i++) scratch_[i] = (*array)[order[i]];
+      array->swap(scratch_);
+    }
+    tag_scratch_.resize(tags_.size());
+    for (int i = 0; i < size_; i++) tag_scratch_[i] = tags_[order[i]];
+    tags_.swap(tag_scratch_);
+  }
+
+  float* x() { return x_.data(); }
+  float* y() { return y_.data(); }
+  float* vx() { return vx_.data(); }
+  float* vy() { return vy_.data(); }
+  const float* x() const { return x_.data(); }
+  const float* y() const { return y_.data(); }
+
+  // Every ball has kNumComponents float components, which include its
+  // position and velocity, as well as its tag. These give each component of
+  // every ball as a single array, in a fixed but otherwise unspecified order,
+  // so that the whole store can be saved and loaded in bulk.
+  static constexpr int kNumComponents = 8;
+  std::span<float> component(int k) {
+    return {arrays()[k]->data(), std::size_t(size_)};
+  }
+  std::span<const float> component(int k) const {
+    return {arrays()[k]->data(), std::size_t(size_)};
+  }
+  std::span<int> tags() { return {tags_.data(), std::size_t(size_)}; }
+  std::span<const int> tags() const {
+    return {tags_.data(), std::size_t(size_)};
+  }
+
+ private:
+  using Array = std::vector<float, AlignedAllocator<float, kBallAlignment>>;
+
+  std::array<Array*, kNumComponents> arrays() {
+    return {&x_, &y_, &vx_, &vy_, &previous_x_, &previous_y_, &rest_x_,
+            &rest_y_};
+  }
+  std::array<const Array*, kNumComponents> arrays() const {
+    return {&x_, &y_, &vx_, &vy_, &previous_x_, &previous_y_, &rest_x_,
+            &rest_y_};
+  }
+
+  int size_ = 0;
+  Array x_, y_, vx_, vy_;
+  Array previous_x_, previous_y_;
+  Array rest_x_, rest_y_;
+  std::vector<int> tags_;
+  Array scratch_;
+  std::vector<int> tag_scratch_;
+};
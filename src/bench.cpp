@@ -0,0 +1,615 @@
+// Headless benchmark for the simulation. Each scenario sets up a world with a
+// fixed seed, runs it for a fixed number of ticks, and reports the throughput
+// along with how settled the balls are at the end, for comparing solvers. It
+// fails if any balls escaped from a scenario which checks for that.
+// With --profile, it also reports the time taken by each phase of a tick, and
+// with --trace it writes every tick of the last scenario to a file, as Chrome
+// trace JSON if the name ends in .json or CSV otherwise.
+//
+// Instead of the built-in scenarios, --scene runs a scene file saved by the
+// game or by --save, and --replay runs an input log recorded by the game with
+// the options it was recorded with. The fingerprint of the final state can be
+// compared between runs to check that they match exactly. A scene file does not
+// hold the world options, so a scene is only continued exactly when it is run
+// with the options it was saved with. --kill-radius sets its kill radius, which
+// is 200 by default, or none to keep every ball.
+//
+// --rate sets the number of ticks per simulated second, 240 by default, and
+// runs cover 10 simulated seconds unless --ticks says otherwise.
+//
+// Usage: bench [--ticks=N] [--rate=N] [--seed=N] [--threads=N]
+//              [--kernels=NAME] [--solver=sequential|jacobi] [--sleep]
+//              [--profile] [--trace=FILE] [--save=FILE]
+//              [--scene=FILE [--kill-radius=N|none] | --replay=FILE |
+//               scenario...]
+
+#include <sys/resource.h>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <numbers>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ball_grid.h"
+#include "input_log.h"
+#include "kernels.h"
+#include "profiler.h"
+#include "world.h"
+
+[[noreturn]] void Die(std::string_view reason) {
+  std::cerr << "Fatal error: " << reason << '\n';
+  std::exit(1);
+}
+
+// The kill radius used by scenarios which let balls fall away forever.
+constexpr float kBoundary = 200;
+
+struct Scenario {
+  std::string_view name;
+  std::optional<float> kill_radius = kBoundary;
+  // Populate the world before the first tick.
+  void (*setup)(World& world, std::mt19937& gen);
+  // Called before every tick to inject more balls, if the scenario needs it.
+  void (*spawn)(World& world, std::mt19937& gen, int tick);
+  // If set, returns true for positions which a ball can only reach by passing
+  // through a line, and the run reports how many balls end up there.
+  bool (*escaped)(glm::vec2 position) = nullptr;
+  // Whether balls may sleep even without --sleep.
+  bool sleep = false;
+};
+
+// Adds a polyline through the given points.
+void AddPath(World& world, std::span<const glm::vec2> points) {
+  for (int i = 1, n = points.size(); i < n; i++) {
+    world.AddLine(Line{.a = points[i - 1], .b = points[i]});
+  }
+}
+
+// Fills the rectangle [min, max] with balls on a hexagonal lattice.
+void AddPile(World& world, glm::vec2 min, glm::vec2 max, int limit) {
+  constexpr float kSpacing = 2.05f * kRadius;
+  const float row_height = kSpacing * std::numbers::sqrt3_v<float> / 2;
+  int count = 0;
+  for (int row = 0; max.y - row * row_height >= min.y; row++) {
+    const float y = max.y - row * row_height;
+    for (float x = min.x + (row % 2) * kSpacing / 2; x <= max.x;
+         x += kSpacing) {
+      if (count++ == limit) return;
+      world.AddBall(Ball{.position = glm::vec2(x, y)});
+    }
+  }
+}
+
+// A stream of balls poured onto a zig-zag of shelves, each of which is made of
+// several short segments. The rows are spawned at the same times whatever the
+// tick rate.
+constexpr Scenario kPour = {
+    .name = "pour",
+    .setup =
+        [](World& world, std::mt19937&) {
+          constexpr int kShelves = 8;
+          constexpr int kSegments = 8;
+          for (int i = 0; i < kShelves; i++) {
+            const float side = i % 2 ? 1.0f : -1.0f;
+            const glm::vec2 a(side * 40, -80 + 20 * i);
+            const glm::vec2 b(-side * 10, -70 + 20 * i);
+            for (int j = 0; j < kSegments; j++) {
+              world.AddLine(
+                  Line{.a = a + (b - a) * (float(j) / kSegments),
+                       .b = a + (b - a) * (float(j + 1) / kSegments)});
+            }
+          }
+        },
+    .spawn =
+        [](World& world, std::mt19937& gen, int tick) {
+          constexpr int kMaxBalls = 3000;
+          constexpr int kPerRow = 12;
+          constexpr int kRowsPerSecond = 15;
+          const int rate = world.tick_rate();
+          if (tick * kRowsPerSecond % rate >= kRowsPerSecond ||
+              tick * kRowsPerSecond / rate * kPerRow >= kMaxBalls) {
+            return;
+          }
+          std::uniform_real_distribution<float> jitter(-0.2f, 0.2f);
+          std::array<Ball, kPerRow> row;
+          for (int i = 0; i < kPerRow; i++) {
+            row[i] = Ball{
+                .position = glm::vec2(-40 + 2.5f * i + jitter(gen), -120),
+                .velocity = glm::vec2(0, 40)};
+          }
+          world.AddBalls(row);
+        },
+};
+
+// A large, dense pile of balls settling in a box.
+constexpr Scenario kPile = {
+    .name = "pile",
+    .setup =
+        [](World& world, std::mt19937&) {
+          AddPath(world, std::array{glm::vec2(-100, -50), glm::vec2(-100, 50),
+                                    glm::vec2(100, 50), glm::vec2(100, -50)});
+          AddPile(world, glm::vec2(-98, 0), glm::vec2(98, 48), 6000);
+        },
+    .spawn = [](World&, std::mt19937&, int) {},
+};
+
+// A block of balls falling through a long funnel made of two long segments.
+constexpr Scenario kFunnel = {
+    .name = "funnel",
+    .setup =
+        [](World& world, std::mt19937&) {
+          world.AddLine(
+              Line{.a = glm::vec2(-150, -150), .b = glm::vec2(-4, 100)});
+          world.AddLine(
+              Line{.a = glm::vec2(150, -150), .b = glm::vec2(4, 100)});
+          AddPile(world, glm::vec2(-60, -180), glm::vec2(60, -120), 2000);
+        },
+    .spawn = [](World&, std::mt19937&, int) {},
+};
+
+// A small pile of balls in a box, far away from a large scribble made of many
+// short segments.
+constexpr Scenario kScribble = {
+    .name = "scribble",
+    .setup =
+        [](World& world, std::mt19937& gen) {
+          constexpr int kSegments = 20000;
+          std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+          glm::vec2 p(0, 100);
+          for (int i = 0; i < kSegments; i++) {
+            const glm::vec2 q = glm::clamp(p + glm::vec2(step(gen), step(gen)),
+                                           glm::vec2(-150, 20),
+                                           glm::vec2(150, 150));
+            world.AddLine(Line{.a = p, .b = q});
+            p = q;
+          }
+          AddPath(world, std::array{glm::vec2(-20, -100), glm::vec2(-20, -50),
+                                    glm::vec2(20, -50), glm::vec2(20, -100)});
+          AddPile(world, glm::vec2(-18, -90), glm::vec2(18, -52), 1000);
+        },
+    .spawn = [](World&, std::mt19937&, int) {},
+};
+
+// Balls thrown in every direction at high speed inside a box of single
+// segments. None should ever get out, whatever the tick rate.
+constexpr float kTunnelBox = 40;
+constexpr Scenario kTunnel = {
+    .name = "tunnel",
+    .kill_radius = std::nullopt,
+    .setup =
+        [](World& world, std::mt19937& gen) {
+          AddPath(world, std::array{glm::vec2(-kTunnelBox, -kTunnelBox),
+                                    glm::vec2(kTunnelBox, -kTunnelBox),
+                                    glm::vec2(kTunnelBox, kTunnelBox),
+                                    glm::vec2(-kTunnelBox, kTunnelBox),
+                                    glm::vec2(-kTunnelBox, -kTunnelBox)});
+          std::uniform_real_distribution<float> angle(
+              0, 2 * std::numbers::pi_v<float>);
+          std::uniform_real_distribution<float> speed(150, 600);
+          for (int y = -10; y < 10; y++) {
+            for (int x = -10; x < 10; x++) {
+              const float a = angle(gen), s = speed(gen);
+              world.AddBall(Ball{
+                  .position = glm::vec2(3.5f * x + 1, 3.5f * y + 1),
+                  .velocity = s * glm::vec2(std::cos(a), std::sin(a))});
+            }
+          }
+        },
+    .spawn = [](World&, std::mt19937&, int) {},
+    .escaped =
+        [](glm::vec2 position) {
+          return std::abs(position.x) > kTunnelBox ||
+                 std::abs(position.y) > kTunnelBox;
+        },
+};
+
+// The same box with a shallow pile on its floor, which is left to fall asleep
+// before balls are thrown down at it at high speed. They should bounce off the
+// sleeping balls rather than pass into the pile.
+constexpr int kTunnelSleepSeconds = 2;
+constexpr Scenario kTunnelSleep = {
+    .name = "tunnelsleep",
+    .kill_radius = std::nullopt,
+    .setup =
+        [](World& world, std::mt19937&) {
+          AddPath(world, std::array{glm::vec2(-kTunnelBox, -kTunnelBox),
+                                    glm::vec2(kTunnelBox, -kTunnelBox),
+                                    glm::vec2(kTunnelBox, kTunnelBox),
+                                    glm::vec2(-kTunnelBox, kTunnelBox),
+                                    glm::vec2(-kTunnelBox, -kTunnelBox)});
+          AddPile(world, glm::vec2(2 - kTunnelBox, kTunnelBox - 8),
+                  glm::vec2(kTunnelBox - 2, kTunnelBox - 2), 1000);
+        },
+    .spawn =
+        [](World& world, std::mt19937& gen, int tick) {
+          if (tick != kTunnelSleepSeconds * world.tick_rate()) return;
+          constexpr float kPi = std::numbers::pi_v<float>;
+          std::uniform_real_distribution<float> angle(kPi / 4, 3 * kPi / 4);
+          std::uniform_real_distribution<float> speed(600, 900);
+          std::vector<Ball> balls;
+          for (int y = 0; y < 5; y++) {
+            for (int x = -10; x < 10; x++) {
+              const float a = angle(gen), s = speed(gen);
+              balls.push_back(
+                  Ball{.position = glm::vec2(3.5f * x + 1, 3.5f * y - 30),
+                       .velocity = s * glm::vec2(std::cos(a), std::sin(a))});
+            }
+          }
+          world.AddBalls(balls);
+        },
+    .escaped = kTunnel.escaped,
+    .sleep = true,
+};
+
+// Streams of thousands of balls per second from a row of emitters, falling
+// onto a roof and rolling off it out of the kill radius. The emitters are far
+// enough apart that their lanes do not overlap, and far enough inside the kill
+// radius that no ball is removed before it reaches the roof.
+constexpr Scenario kEmit = {
+    .name = "emit",
+    .setup =
+        [](World& world, std::mt19937&) {
+          for (int i = 0; i < 4; i++) {
+            world.AddEmitter(
+                Emitter{.position = glm::vec2(-112.5f + 75 * i, -100),
+                        .velocity = glm::vec2(0, 80),
+                        .rate = 1000,
+                        .spread = 0.05f});
+          }
+          world.AddLine(Line{.a = glm::vec2(0, -60), .b = glm::vec2(-150, 0)});
+          world.AddLine(Line{.a = glm::vec2(0, -60), .b = glm::vec2(150, 0)});
+        },
+    .spawn = [](World&, std::mt19937&, int) {},
+};
+
+// A pile of balls settling in a box, whose floor of several segments is
+// removed from under it after a few seconds. Every ball should then fall out
+// of the kill radius, including those which have gone to sleep.
+constexpr int kTrapdoorSegments = 4;
+constexpr int kTrapdoorSeconds = 3;
+constexpr Scenario kTrapdoor = {
+    .name = "trapdoor",
+    .setup =
+        [](World& world, std::mt19937&) {
+          world.AddLine(
+              Line{.a = glm::vec2(-20, -20), .b = glm::vec2(-20, 20)});
+          for (int i = 0; i < kTrapdoorSegments; i++) {
+            const float x = -20 + 40.0f * i / kTrapdoorSegments;
+            world.AddLine(Line{
+                .a = glm::vec2(x, 20),
+                .b = glm::vec2(x + 40.0f / kTrapdoorSegments, 20)});
+          }
+          world.AddLine(Line{.a = glm::vec2(20, 20), .b = glm::vec2(20, -20)});
+          AddPile(world, glm::vec2(-18, -10), glm::vec2(18, 18), 1000);
+        },
+    .spawn =
+        [](World& world, std::mt19937&, int tick) {
+          if (tick != kTrapdoorSeconds * world.tick_rate()) return;
+          // Removing a line moves the last line into its place, so the floor
+          // is found by where it is rather than by index.
+          for (int i = 0; i < int(world.lines().size());) {
+            const Line& line = world.lines()[i];
+            if (line.a.y == 20 && line.b.y == 20) {
+              world.RemoveLine(i);
+            } else {
+              i++;
+            }
+          }
+        },
+};
+
+// Several small piles in boxes, spread out over a square with the given
+// half-width, without any kill volume. The cost should not depend on the
+// spread.
+template <int kExtent>
+void SetupSpread(World& world, std::mt19937&) {
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      const glm::vec2 c(x * kExtent, y * kExtent);
+      AddPath(world, std::array{c + glm::vec2(-20, -20), c + glm::vec2(-20, 20),
+                                c + glm::vec2(20, 20), c + glm::vec2(20, -20)});
+      AddPile(world, c + glm::vec2(-18, -10), c + glm::vec2(18, 18), 1000);
+    }
+  }
+}
+
+constexpr Scenario kSpread = {
+    .name = "spread",
+    .kill_radius = std::nullopt,
+    .setup = SetupSpread<100>,
+    .spawn = [](World&, std::mt19937&, int) {},
+};
+
+constexpr Scenario kSpreadFar = {
+    .name = "spread100",
+    .kill_radius = std::nullopt,
+    .setup = SetupSpread<10000>,
+    .spawn = [](World&, std::mt19937&, int) {},
+};
+
+constexpr Scenario kScenarios[] = {kPour,   kPile,      kFunnel, kScribble,
+                                   kSpread, kSpreadFar, kTunnel, kTunnelSleep,
+                                   kEmit,   kTrapdoor};
+
+long PeakMemoryKiB() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) Die("getrusage");
+  return usage.ru_maxrss;
+}
+
+struct Stability {
+  // The root mean square speed of the balls.
+  double rms_speed = 0;
+  // The mean and deepest overlap between touching balls.
+  double mean_overlap = 0;
+  float max_overlap = 0;
+};
+
+Stability MeasureStability(const World& world) {
+  BallStore balls = world.balls();
+  const BallStore& sleeping = world.sleeping_balls();
+  for (int i = 0; i < sleeping.size(); i++) balls.push_back(sleeping[i]);
+  const int n = balls.size();
+  if (n == 0) return {};
+  std::vector<int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  BallGrid grid(2 * kRadius);
+  grid.Build(balls, order);
+
+  Stability stability;
+  int contacts = 0;
+  for (int slot = 0; slot < grid.num_cells(); slot++) {
+    const BallGrid::Cell cell = grid.cell(slot);
+    for (int i = grid.begin(slot); i < grid.end(slot); i++) {
+      const Ball a = balls[i];
+      stability.rms_speed += glm::dot(a.velocity, a.velocity);
+      for (int dy = -1; dy <= 1; dy++) {
+        const BallGrid::Range row =
+            grid.FindRow(cell.y + dy, cell.x - 1, cell.x + 1);
+        for (int j = row.begin; j < row.end; j++) {
+          if (j == i) continue;
+          const float overlap =
+              2 * kRadius - glm::distance(a.position, balls.position(j));
+          if (overlap <= 0) continue;
+          stability.mean_overlap += overlap;
+          stability.max_overlap = std::max(stability.max_overlap, overlap);
+          contacts++;
+        }
+      }
+    }
+  }
+  stability.rms_speed = std::sqrt(stability.rms_speed / n);
+  if (contacts) stability.mean_overlap /= contacts;
+  return stability;
+}
+
+std::string_view SolverName(Solver solver) {
+  switch (solver) {
+    case Solver::kSequential:
+      return "sequential";
+    case Solver::kJacobi:
+      return "jacobi";
+  }
+  Die("unknown solver");
+}
+
+void PrintProfile(const Profiler& profiler) {
+  const std::vector<Profiler::Summary> summaries = profiler.Summarize();
+  std::cout << "  " << std::left << std::setw(16) << "metric" << std::right
+            << std::setw(12) << "mean" << std::setw(12) << "p50"
+            << std::setw(12) << "p95" << std::setw(12) << "p99" << '\n';
+  for (int m = 0, n = summaries.size(); m < n; m++) {
+    const Profiler::Metric& metric = profiler.metrics()[m];
+    // Show times in microseconds.
+    const double scale = metric.kind == Profiler::Kind::kTime ? 1e6 : 1;
+    const Profiler::Summary& summary = summaries[m];
+    std::cout << "  " << std::left << std::setw(16) << metric.name
+              << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << summary.mean * scale << std::setw(12)
+              << summary.p50 * scale << std::setw(12) << summary.p95 * scale
+              << std::setw(12) << summary.p99 * scale << '\n';
+  }
+}
+
+// What to report about each run, besides its throughput and stability.
+struct Reports {
+  bool profile = false;
+  std::filesystem::path trace;
+  // If set, the final state of the world is saved to this scene file.
+  std::filesystem::path save;
+};
+
+// Runs a world for the given number of ticks, after populating it with setup
+// and calling edit before every tick. If escaped is set, the balls for which it
+// returns true at the end are counted, and the count is returned.
+int Run(std::string_view name, int ticks, WorldOptions options,
+         const std::function<void(World&)>& setup,
+         const std::function<void(World&, int)>& edit,
+         bool (*escaped)(glm::vec2), const Reports& reports) {
+  const std::filesystem::path& trace = reports.trace;
+  Profiler profiler("world", kWorldMetrics, std::max(1, ticks));
+  if (reports.profile || !trace.empty()) {
+    profiler.set_enabled(true);
+    options.profiler = &profiler;
+  }
+  if (!trace.empty()) profiler.StartTrace();
+  World world(options);
+  setup(world);
+
+  using Clock = std::chrono::steady_clock;
+  Clock::duration elapsed{};
+  std::int64_t ball_ticks = 0, awake_ball_ticks = 0;
+  for (int i = 0; i < ticks; i++) {
+    edit(world, i);
+    ball_ticks += world.balls().size() + world.sleeping_balls().size();
+    awake_ball_ticks += world.balls().size();
+    const Clock::time_point start = Clock::now();
+    world.Update();
+    elapsed += Clock::now() - start;
+  }
+
+  const double seconds = std::chrono::duration<double>(elapsed).count();
+  const Stability stability = MeasureStability(world);
+  int num_escaped = 0;
+  if (escaped) {
+    for (const BallStore* balls : {&world.balls(), &world.sleeping_balls()}) {
+      for (int i = 0, n = balls->size(); i < n; i++) {
+        num_escaped += escaped(balls->position(i));
+      }
+    }
+  }
+  std::cout << std::left << std::setw(10) << name << std::right
+            << std::fixed << std::setprecision(1)
+            << " lines=" << world.lines().size()
+            << " balls="
+            << world.balls().size() + world.sleeping_balls().size()
+            << " asleep=" << world.sleeping_balls().size()
+            << " ticks=" << ticks
+            << " rate=" << options.tick_rate
+            << " threads=" << options.threads
+            << " kernels=" << KernelsName()
+            << " solver=" << SolverName(options.solver)
+            << " sleep=" << options.sleep
+            << " ticks/s=" << ticks / seconds
+            << " sim_s/s=" << ticks / seconds / options.tick_rate
+            << " ns/ball/tick="
+            << (ball_ticks ? 1e9 * seconds / ball_ticks : 0.0)
+            << " ns/awake_ball/tick="
+            << (awake_ball_ticks ? 1e9 * seconds / awake_ball_ticks : 0.0)
+            << std::setprecision(3)
+            << " rms_speed=" << stability.rms_speed
+            << " mean_overlap=" << stability.mean_overlap
+            << " max_overlap=" << stability.max_overlap;
+  if (escaped) std::cout << " escaped=" << num_escaped;
+  std::cout << " peak_rss=" << PeakMemoryKiB() << "KiB"
+            << " fingerprint=" << std::hex << std::setfill('0')
+            << std::setw(16) << world.Fingerprint() << std::dec
+            << std::setfill(' ') << '\n';
+  if (reports.profile) PrintProfile(profiler);
+  if (!trace.empty()) {
+    const Profiler* const profilers[] = {&profiler};
+    if (!(trace.extension() == ".json"
+              ? Profiler::WriteChromeTrace(trace, profilers)
+              : profiler.WriteCsv(trace))) {
+      Die("failed to write trace");
+    }
+  }
+  if (!reports.save.empty() && !world.Save(reports.save)) {
+    Die("failed to save the scene");
+  }
+  return num_escaped;
+}
+
+int main(int argc, char* argv[]) {
+  // By default, each run covers 10 seconds of simulated time.
+  std::optional<int> ticks;
+  WorldOptions options{.seed = 1};
+  Reports reports;
+  std::filesystem::path scene;
+  std::optional<float> scene_kill_radius = kBoundary;
+  std::optional<InputLog> log;
+  std::vector<const Scenario*> selected;
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--ticks=")) {
+      ticks = std::stoi(std::string(arg.substr(8)));
+    } else if (arg.starts_with("--rate=")) {
+      options.tick_rate = std::stoi(std::string(arg.substr(7)));
+      if (options.tick_rate <= 0) Die("the tick rate must be positive");
+    } else if (arg.starts_with("--seed=")) {
+      options.seed = std::stoul(std::string(arg.substr(7)));
+    } else if (arg.starts_with("--threads=")) {
+      options.threads = std::stoi(std::string(arg.substr(10)));
+    } else if (arg.starts_with("--kernels=")) {
+      if (!SelectKernels(arg.substr(10))) Die("unsupported kernels");
+    } else if (arg == "--profile") {
+      reports.profile = true;
+    } else if (arg.starts_with("--trace=")) {
+      reports.trace = arg.substr(8);
+    } else if (arg.starts_with("--save=")) {
+      reports.save = arg.substr(7);
+    } else if (arg.starts_with("--scene=")) {
+      scene = arg.substr(8);
+    } else if (arg.starts_with("--kill-radius=")) {
+      const std::string value(arg.substr(14));
+      if (value == "none") {
+        scene_kill_radius = std::nullopt;
+      } else {
+        scene_kill_radius = std::stof(value);
+        if (*scene_kill_radius <= 0) Die("the kill radius must be positive");
+      }
+    } else if (arg.starts_with("--replay=")) {
+      log = InputLog::Read(arg.substr(9));
+      if (!log) Die("failed to read the input log");
+    } else if (arg == "--sleep") {
+      options.sleep = true;
+    } else if (arg.starts_with("--solver=")) {
+      const std::string_view name = arg.substr(9);
+      if (name == SolverName(Solver::kSequential)) {
+        options.solver = Solver::kSequential;
+      } else if (name == SolverName(Solver::kJacobi)) {
+        options.solver = Solver::kJacobi;
+      } else {
+        Die("unknown solver");
+      }
+    } else {
+      const Scenario* match = nullptr;
+      for (const Scenario& scenario : kScenarios) {
+        if (scenario.name == arg) match = &scenario;
+      }
+      if (!match) Die("unknown scenario");
+      selected.push_back(match);
+    }
+  }
+
+  if (!ticks) ticks = 10 * options.tick_rate;
+  if (!scene.empty()) {
+    options.kill_radius = scene_kill_radius;
+    Run(
+        "scene", *ticks, options,
+        [&](World& world) {
+          if (!world.Load(scene)) Die("failed to load the scene");
+        },
+        [](World&, int) {}, nullptr, reports);
+    return 0;
+  }
+  if (log) {
+    const int threads = options.threads;
+    options = log->options;
+    options.threads = threads;
+    Replay replay(*log);
+    Run(
+        "replay", log->ticks, options, [](World&) {},
+        [&](World& world, int) { replay.Apply(world); }, nullptr, reports);
+    return 0;
+  }
+
+  if (selected.empty()) {
+    for (const Scenario& scenario : kScenarios) selected.push_back(&scenario);
+  }
+  // Every scenario runs even if one fails, so that all of them are reported.
+  int num_escaped = 0;
+  for (const Scenario* scenario : selected) {
+    WorldOptions scenario_options = options;
+    scenario_options.kill_radius = scenario->kill_radius;
+    scenario_options.sleep |= scenario->sleep;
+    std::mt19937 gen(options.seed);
+    num_escaped += Run(
+        scenario->name, *ticks, scenario_options,
+        [&](World& world) { scenario->setup(world, gen); },
+        [&](World& world, int tick) { scenario->spawn(world, gen, tick); },
+        scenario->escaped, reports);
+  }
+  if (num_escaped > 0) Die("balls escaped");
+}
@@ -0,0 +1,8 @@
+#version 430 core
+
+layout(location = 0) in float density;
+layout(location = 0) out vec4 color;
+
+void main() {
+  color = vec4(1.0f, 1.0f, 1.0f, density);
+}
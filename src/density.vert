@@ -0,0 +1,15 @@
+#version 430 core
+
+layout(binding = 0) uniform MVP {
+  mat4 matrix;
+};
+
+layout(location = 0) in vec2 vertex;
+// The center of the tile, half its size, and its density.
+layout(location = 1) in vec4 tile;
+layout(location = 0) out float density;
+
+void main() {
+  density = tile.w;
+  gl_Position = matrix * vec4(vertex * tile.z + tile.xy, 0.0, 1.0);
+}
@@ -0,0 +1,28 @@
+#include "gpu_timer.h"
+
+GpuTimer::GpuTimer() { glGenQueries(kNumQueries, queries_.data()); }
+
+GpuTimer::~GpuTimer() { glDeleteQueries(kNumQueries, queries_.data()); }
+
+std::optional<double> GpuTimer::Begin() {
+  // Reuse the oldest query. If its result is still not ready, it is dropped.
+  std::optional<double> result;
+  const GLuint query = queries_[next_];
+  if (pending_[next_]) {
+    GLint available;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      GLuint64 nanoseconds;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+      result = nanoseconds * 1e-9;
+    }
+  }
+  glBeginQuery(GL_TIME_ELAPSED, query);
+  return result;
+}
+
+void GpuTimer::End() {
+  glEndQuery(GL_TIME_ELAPSED);
+  pending_[next_] = true;
+  next_ = (next_ + 1) % kNumQueries;
+}
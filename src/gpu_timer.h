@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <array>
+#include <optional>
+
+// Measures how long the GPU spends on a section of each frame using
+// GL_TIME_ELAPSED queries. A query is only read back once the GPU has finished
+// with it, a few frames later, so that timing never stalls the pipeline.
+class GpuTimer {
+ public:
+  GpuTimer();
+  ~GpuTimer();
+
+  GpuTimer(const GpuTimer&) = delete;
+  GpuTimer& operator=(const GpuTimer&) = delete;
+
+  // Starts timing. Returns the time in seconds measured by the oldest
+  // unread query, if it is ready.
+  std::optional<double> Begin();
+  void End();
+
+ private:
+  static constexpr int kNumQueries = 4;
+
+  std::array<GLuint, kNumQueries> queries_;
+  std::array<bool, kNumQueries> pending_ = {};
+  int next_ = 0;
+};
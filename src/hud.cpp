@@ -0,0 +1,106 @@
+#include "hud.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr int kVertex = 0;  // layout(location = 0) in vec2 vertex;
+constexpr int kMvp = 0;     // layout(binding = 0) uniform MVP { ... }
+
+// Glyphs are 3x5 pixels, given as rows from top to bottom.
+constexpr int kGlyphWidth = 3, kGlyphHeight = 5;
+struct Glyph {
+  char c;
+  std::string_view pixels;
+};
+constexpr Glyph kFont[] = {
+    {'0', "111101101101111"}, {'1', "010110010010111"},
+    {'2', "111001111100111"}, {'3', "111001111001111"},
+    {'4', "101101111001001"}, {'5', "111100111001111"},
+    {'6', "111100111101111"}, {'7', "111001001001001"},
+    {'8', "111101111101111"}, {'9', "111101111001111"},
+    {'A', "010101111101101"}, {'B', "110101110101110"},
+    {'C', "011100100100011"}, {'D', "110101101101110"},
+    {'E', "111100110100111"}, {'F', "111100110100100"},
+    {'G', "011100101101011"}, {'H', "101101111101101"},
+    {'I', "111010010010111"}, {'J', "001001001101010"},
+    {'K', "101101110101101"}, {'L', "100100100100111"},
+    {'M', "101111111101101"}, {'N', "110101101101101"},
+    {'O', "010101101101010"}, {'P', "110101110100100"},
+    {'Q', "010101101110011"}, {'R', "110101110101101"},
+    {'S', "011100010001110"}, {'T', "111010010010010"},
+    {'U', "101101101101111"}, {'V', "101101101101010"},
+    {'W', "101101111111101"}, {'X', "101101010101101"},
+    {'Y', "101101010010010"}, {'Z', "111001010100111"},
+    {'.', "000000000000010"}, {':', "000010000010000"},
+    {'-', "000000111000000"}, {'_', "000000000000111"},
+    {'/', "001001010100100"}, {'%', "101001010100101"},
+    {'(', "001010010010001"}, {')', "100010010010100"},
+};
+
+// The size of a font pixel on screen, and the spacing of the glyphs.
+constexpr float kPixel = 2;
+constexpr float kAdvance = (kGlyphWidth + 1) * kPixel;
+constexpr float kLineHeight = (kGlyphHeight + 2) * kPixel;
+constexpr float kMargin = 8;
+
+std::string_view FindGlyph(char c) {
+  c = std::toupper(static_cast<unsigned char>(c));
+  for (const Glyph& glyph : kFont) {
+    if (glyph.c == c) return glyph.pixels;
+  }
+  return {};
+}
+
+}  // namespace
+
+Hud::Hud(GLuint shader) : shader_(shader) { glGenBuffers(1, &mvp_); }
+
+Hud::~Hud() { glDeleteBuffers(1, &mvp_); }
+
+void Hud::Draw(std::span<const std::string> lines, int width, int height) {
+  // Build two triangles for every lit pixel of every glyph.
+  std::vector<glm::vec2> triangles;
+  for (int row = 0, n = lines.size(); row < n; row++) {
+    const float y = kMargin + row * kLineHeight;
+    for (int column = 0, m = lines[row].size(); column < m; column++) {
+      const std::string_view pixels = FindGlyph(lines[row][column]);
+      const float x = kMargin + column * kAdvance;
+      for (int i = 0, p = pixels.size(); i < p; i++) {
+        if (pixels[i] != '1') continue;
+        const glm::vec2 a(x + i % kGlyphWidth * kPixel,
+                          y + i / kGlyphWidth * kPixel);
+        const glm::vec2 b = a + glm::vec2(kPixel);
+        triangles.insert(triangles.end(), {a, glm::vec2(b.x, a.y), b, a, b,
+                                           glm::vec2(a.x, b.y)});
+      }
+    }
+  }
+  if (triangles.empty()) return;
+
+  // Draw in screen coordinates, with the origin at the top left.
+  const glm::mat4 matrix =
+      glm::ortho(0.0f, float(width), float(height), 0.0f, 1.0f, -1.0f);
+  glBindBuffer(GL_UNIFORM_BUFFER, mvp_);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(matrix), &matrix, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, kMvp, mvp_);
+
+  glm::vec2* const data = vertices_.Map<glm::vec2>(triangles.size());
+  std::copy(triangles.begin(), triangles.end(), data);
+  glBindBuffer(GL_ARRAY_BUFFER, vertices_.buffer());
+  glEnableVertexAttribArray(kVertex);
+  glVertexAttribPointer(kVertex, 2, GL_FLOAT, GL_FALSE, 0,
+                        (const void*)vertices_.offset());
+
+  glUseProgram(shader_);
+  glDrawArrays(GL_TRIANGLES, 0, triangles.size());
+  vertices_.Fence();
+
+  glDisableVertexAttribArray(kVertex);
+}
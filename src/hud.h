@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <span>
+#include <string>
+
+#include "stream_buffer.h"
+
+// Draws lines of text over the top left corner of the screen, using a tiny
+// built-in bitmap font with each pixel drawn as a square.
+class Hud {
+ public:
+  // shader must draw triangles in a flat colour, taking a vec2 vertex at
+  // location 0 and its matrix from the uniform block at binding 0.
+  explicit Hud(GLuint shader);
+  ~Hud();
+
+  Hud(const Hud&) = delete;
+  Hud& operator=(const Hud&) = delete;
+
+  void Draw(std::span<const std::string> lines, int width, int height);
+
+ private:
+  const GLuint shader_;
+  GLuint mvp_;
+  StreamBuffer vertices_;
+};
@@ -0,0 +1,155 @@
+#include "input_log.h"
+
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include "mapped_file.h"
+
+namespace {
+
+// An input log is a LogHeader followed by an EventRecord for each event.
+// Values are stored in the byte order of the machine which wrote the file.
+constexpr char kLogMagic[8] = "BALLLOG";
+constexpr std::uint32_t kLogVersion = 3;
+constexpr std::uint32_t kByteOrderMark = 0x01020304;
+
+struct LogHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t seed;
+  std::uint32_t solver;
+  std::uint32_t sleep;
+  std::uint32_t has_kill_radius;
+  float kill_radius;
+  std::uint32_t tick_rate;
+  std::uint64_t ticks;
+  std::uint64_t num_events;
+};
+
+enum EventKind : std::uint32_t { kBallEvent, kLineEvent, kEmitterEvent };
+
+struct EventRecord {
+  std::uint64_t tick;
+  EventKind kind;
+  // A ball's position and velocity, a line's end points, or an emitter's
+  // position, velocity, rate and spread.
+  float values[6];
+  std::uint32_t padding;
+};
+static_assert(std::is_trivially_copyable_v<LogHeader>);
+static_assert(std::is_trivially_copyable_v<EventRecord>);
+static_assert(sizeof(Emitter) <= sizeof(EventRecord::values));
+
+}  // namespace
+
+void ApplyEdit(World& world, const Edit& edit) {
+  if (const Ball* ball = std::get_if<Ball>(&edit)) {
+    world.AddBall(*ball);
+  } else if (const Line* line = std::get_if<Line>(&edit)) {
+    world.AddLine(*line);
+  } else {
+    world.AddEmitter(std::get<Emitter>(edit));
+  }
+}
+
+bool InputLog::Write(const std::filesystem::path& path) const {
+  LogHeader header = {};
+  std::memcpy(header.magic, kLogMagic, sizeof(header.magic));
+  header.version = kLogVersion;
+  header.byte_order = kByteOrderMark;
+  header.seed = options.seed;
+  header.solver = std::uint32_t(options.solver);
+  header.sleep = options.sleep;
+  header.has_kill_radius = options.kill_radius.has_value();
+  header.kill_radius = options.kill_radius.value_or(0);
+  header.tick_rate = options.tick_rate;
+  header.ticks = ticks;
+  header.num_events = events.size();
+
+  std::vector<EventRecord> records;
+  records.reserve(events.size());
+  for (const Event& event : events) {
+    EventRecord record = {.tick = event.tick};
+    if (const Ball* ball = std::get_if<Ball>(&event.edit)) {
+      record.kind = kBallEvent;
+      std::memcpy(record.values, ball, sizeof(*ball));
+    } else if (const Line* line = std::get_if<Line>(&event.edit)) {
+      record.kind = kLineEvent;
+      std::memcpy(record.values, line, sizeof(*line));
+    } else {
+      record.kind = kEmitterEvent;
+      std::memcpy(record.values, &std::get<Emitter>(event.edit),
+                  sizeof(Emitter));
+    }
+    records.push_back(record);
+  }
+
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(records.data()),
+             sizeof(EventRecord) * records.size());
+  return file.good();
+}
+
+std::optional<InputLog> InputLog::Read(const std::filesystem::path& path) {
+  MappedFile file;
+  if (!file.Open(path)) return std::nullopt;
+  const std::span<const std::byte> bytes = file.bytes();
+
+  LogHeader header;
+  if (bytes.size() < sizeof(header)) return std::nullopt;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  if (std::memcmp(header.magic, kLogMagic, sizeof(header.magic)) != 0 ||
+      header.version != kLogVersion || header.byte_order != kByteOrderMark ||
+      header.solver > std::uint32_t(Solver::kJacobi) ||
+      header.tick_rate == 0 || header.tick_rate > INT_MAX ||
+      header.num_events >
+          (bytes.size() - sizeof(header)) / sizeof(EventRecord)) {
+    return std::nullopt;
+  }
+
+  InputLog log;
+  log.options.seed = header.seed;
+  log.options.solver = Solver(header.solver);
+  log.options.sleep = header.sleep;
+  log.options.tick_rate = header.tick_rate;
+  if (header.has_kill_radius) log.options.kill_radius = header.kill_radius;
+  log.ticks = header.ticks;
+  log.events.reserve(header.num_events);
+  for (std::uint64_t i = 0; i < header.num_events; i++) {
+    EventRecord record;
+    std::memcpy(&record, bytes.data() + sizeof(header) + i * sizeof(record),
+                sizeof(record));
+    Event event = {.tick = record.tick};
+    if (record.kind == kBallEvent) {
+      Ball ball;
+      std::memcpy(&ball, record.values, sizeof(ball));
+      event.edit = ball;
+    } else if (record.kind == kLineEvent) {
+      Line line;
+      std::memcpy(&line, record.values, sizeof(line));
+      event.edit = line;
+    } else if (record.kind == kEmitterEvent) {
+      Emitter emitter;
+      std::memcpy(&emitter, record.values, sizeof(emitter));
+      event.edit = emitter;
+    } else {
+      return std::nullopt;
+    }
+    log.events.push_back(event);
+  }
+  return log;
+}
+
+bool Replay::Apply(World& world) {
+  if (tick_ == log_.ticks) return false;
+  for (; next_ < log_.events.size() && log_.events[next_].tick <= tick_;
+       next_++) {
+    ApplyEdit(world, log_.events[next_].edit);
+  }
+  tick_++;
+  return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <variant>
+#include <vector>
+
+#include "world.h"
+
+// An edit made to a world between ticks: a ball, a line or an emitter to add.
+using Edit = std::variant<Ball, Line, Emitter>;
+
+void ApplyEdit(World& world, const Edit& edit);
+
+// A recording of the edits made to a world, each with the number of ticks
+// which had run when it was made, along with the options which affect how the
+// world evolves. A new world with those options which is given the same edits
+// at the same ticks reaches exactly the same state, as long as it runs on the
+// same kind of machine with the same kernels. The number of threads does not
+// matter.
+struct InputLog {
+  struct Event {
+    std::uint64_t tick;
+    Edit edit;
+  };
+
+  // Only the seed, tick rate, kill radius, solver and sleep options are
+  // recorded.
+  WorldOptions options;
+  // The events, in order of tick.
+  std::vector<Event> events;
+  // The number of ticks which were run in total.
+  std::uint64_t ticks = 0;
+
+  // Returns false if the file could not be written.
+  bool Write(const std::filesystem::path& path) const;
+  // Returns nothing if the file could not be read or is not an input log
+  // written by a compatible version on a machine with the same byte order.
+  static std::optional<InputLog> Read(const std::filesystem::path& path);
+};
+
+// Plays the events from a log into a world.
+class Replay {
+ public:
+  explicit Replay(const InputLog& log) : log_(log) {}
+
+  // Applies the edits which were made before the next tick, which the caller
+  // must then run. Returns false, without applying anything, once every tick
+  // has been run.
+  bool Apply(World& world);
+
+  std::uint64_t tick() const { return tick_; }
+
+ private:
+  const InputLog& log_;
+  std::uint64_t tick_ = 0;
+  std::size_t next_ = 0;
+};
@@ -0,0 +1,245 @@
+#include "kernels.h"
+
+#include "ball_store.h"
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BALLS_X86 1
+#endif
+
+namespace {
+
+void IntegrateBallsScalar(float* x, float* y, float* vx, float* vy, int begin,
+                          int n, glm::vec2 dv, float dt) {
+  for (int i = begin; i < n; i++) {
+    vx[i] += dv.x;
+    vy[i] += dv.y;
+    x[i] += vx[i] * dt;
+    y[i] += vy[i] * dt;
+  }
+}
+
+int FindBallOutsideScalar(const float* x, const float* y, int begin, int n,
+                          float square_radius) {
+  for (int i = begin; i < n; i++) {
+    if (x[i] * x[i] + y[i] * y[i] > square_radius) return i;
+  }
+  return n;
+}
+
+int FindBallsNearScalar(glm::vec2 p, const float* x, const float* y, int begin,
+                        int n, float square_radius, int* out) {
+  int count = 0;
+  for (int i = begin; i < n; i++) {
+    const float dx = x[i] - p.x, dy = y[i] - p.y;
+    if (dx * dx + dy * dy <= square_radius) out[count++] = i;
+  }
+  return count;
+}
+
+void IntegrateBallsGeneric(float* x, float* y, float* vx, float* vy, int n,
+                           glm::vec2 dv, float dt) {
+  IntegrateBallsScalar(x, y, vx, vy, 0, n, dv, dt);
+}
+
+int FindBallOutsideGeneric(const float* x, const float* y, int begin, int n,
+                           float square_radius) {
+  return FindBallOutsideScalar(x, y, begin, n, square_radius);
+}
+
+int FindBallsNearGeneric(glm::vec2 p, const float* x, const float* y, int n,
+                         float square_radius, int* out) {
+  return FindBallsNearScalar(p, x, y, 0, n, square_radius, out);
+}
+
+// Appends base + i to out for each bit i which is set in mask.
+int AppendIndices(std::uint32_t mask, int base, int* out) {
+  int count = 0;
+  while (mask) {
+    out[count++] = base + std::countr_zero(mask);
+    mask &= mask - 1;
+  }
+  return count;
+}
+
+#ifdef BALLS_X86
+
+void IntegrateBallsSse(float* x, float* y, float* vx, float* vy, int n,
+                       glm::vec2 dv, float dt) {
+  const __m128 dvx = _mm_set1_ps(dv.x), dvy = _mm_set1_ps(dv.y);
+  const __m128 t = _mm_set1_ps(dt);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 new_vx = _mm_add_ps(_mm_load_ps(vx + i), dvx);
+    const __m128 new_vy = _mm_add_ps(_mm_load_ps(vy + i), dvy);
+    _mm_store_ps(vx + i, new_vx);
+    _mm_store_ps(vy + i, new_vy);
+    _mm_store_ps(x + i, _mm_add_ps(_mm_load_ps(x + i), _mm_mul_ps(new_vx, t)));
+    _mm_store_ps(y + i, _mm_add_ps(_mm_load_ps(y + i), _mm_mul_ps(new_vy, t)));
+  }
+  IntegrateBallsScalar(x, y, vx, vy, i, n, dv, dt);
+}
+
+int FindBallOutsideSse(const float* x, const float* y, int begin, int n,
+                       float square_radius) {
+  const __m128 r2 = _mm_set1_ps(square_radius);
+  int i = begin;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i);
+    const __m128 d2 = _mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py));
+    const int mask = _mm_movemask_ps(_mm_cmpgt_ps(d2, r2));
+    if (mask) return i + std::countr_zero(unsigned(mask));
+  }
+  return FindBallOutsideScalar(x, y, i, n, square_radius);
+}
+
+int FindBallsNearSse(glm::vec2 p, const float* x, const float* y, int n,
+                     float square_radius, int* out) {
+  const __m128 r2 = _mm_set1_ps(square_radius);
+  const __m128 cx = _mm_set1_ps(p.x), cy = _mm_set1_ps(p.y);
+  int count = 0, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), cx);
+    const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), cy);
+    const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    const int mask = _mm_movemask_ps(_mm_cmple_ps(d2, r2));
+    count += AppendIndices(mask, i, out + count);
+  }
+  if (i < n) {
+    // Test a whole vector and discard the lanes past the end.
+    const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), cx);
+    const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), cy);
+    const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    const int mask = _mm_movemask_ps(_mm_cmple_ps(d2, r2));
+    count += AppendIndices(mask & ((1 << (n - i)) - 1), i, out + count);
+  }
+  return count;
+}
+
+__attribute__((target("avx2"))) void IntegrateBallsAvx2(
+    float* x, float* y, float* vx, float* vy, int n, glm::vec2 dv, float dt) {
+  const __m256 dvx = _mm256_set1_ps(dv.x), dvy = _mm256_set1_ps(dv.y);
+  const __m256 t = _mm256_set1_ps(dt);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 new_vx = _mm256_add_ps(_mm256_load_ps(vx + i), dvx);
+    const __m256 new_vy = _mm256_add_ps(_mm256_load_ps(vy + i), dvy);
+    _mm256_store_ps(vx + i, new_vx);
+    _mm256_store_ps(vy + i, new_vy);
+    _mm256_store_ps(
+        x + i, _mm256_add_ps(_mm256_load_ps(x + i), _mm256_mul_ps(new_vx, t)));
+    _mm256_store_ps(
+        y + i, _mm256_add_ps(_mm256_load_ps(y + i), _mm256_mul_ps(new_vy, t)));
+  }
+  IntegrateBallsScalar(x, y, vx, vy, i, n, dv, dt);
+}
+
+__attribute__((target("avx2"))) int FindBallOutsideAvx2(
+    const float* x, const float* y, int begin, int n, float square_radius) {
+  const __m256 r2 = _mm256_set1_ps(square_radius);
+  int i = begin;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i);
+    const __m256 d2 =
+        _mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py));
+    const int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_GT_OQ));
+    if (mask) return i + std::countr_zero(unsigned(mask));
+  }
+  return FindBallOutsideScalar(x, y, i, n, square_radius);
+}
+
+__attribute__((target("avx2"))) int FindBallsNearAvx2(
+    glm::vec2 p, const float* x, const float* y, int n, float square_radius,
+    int* out) {
+  const __m256 r2 = _mm256_set1_ps(square_radius);
+  const __m256 cx = _mm256_set1_ps(p.x), cy = _mm256_set1_ps(p.y);
+  int count = 0, i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), cx);
+    const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), cy);
+    const __m256 d2 =
+        _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    const int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LE_OQ));
+    count += AppendIndices(mask, i, out + count);
+  }
+  if (i < n) {
+    // Test a whole vector and discard the lanes past the end.
+    const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), cx);
+    const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), cy);
+    const __m256 d2 =
+        _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    const int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LE_OQ));
+    count += AppendIndices(mask & ((1 << (n - i)) - 1), i, out + count);
+  }
+  return count;
+}
+
+#endif  // BALLS_X86
+
+struct Kernels {
+  std::string_view name;
+  decltype(&IntegrateBallsGeneric) integrate;
+  decltype(&FindBallOutsideGeneric) find_outside;
+  decltype(&FindBallsNearGeneric) find_near;
+};
+
+constexpr Kernels kScalar = {"scalar", IntegrateBallsGeneric,
+                             FindBallOutsideGeneric, FindBallsNearGeneric};
+#ifdef BALLS_X86
+constexpr Kernels kSse = {"sse", IntegrateBallsSse, FindBallOutsideSse,
+                          FindBallsNearSse};
+constexpr Kernels kAvx2 = {"avx2", IntegrateBallsAvx2, FindBallOutsideAvx2,
+                           FindBallsNearAvx2};
+#endif
+
+bool Supported(const Kernels& kernels) {
+#ifdef BALLS_X86
+  __builtin_cpu_init();
+  if (&kernels == &kAvx2) return __builtin_cpu_supports("avx2");
+#endif
+  return true;
+}
+
+const Kernels* kernels = [] {
+#ifdef BALLS_X86
+  return Supported(kAvx2) ? &kAvx2 : &kSse;
+#else
+  return &kScalar;
+#endif
+}();
+
+}  // namespace
+
+bool SelectKernels(std::string_view name) {
+  for (const Kernels* candidate : {
+#ifdef BALLS_X86
+           &kAvx2, &kSse,
+#endif
+           &kScalar}) {
+    if (candidate->name == name && Supported(*candidate)) {
+      kernels = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string_view KernelsName() { return kernels->name; }
+
+void IntegrateBalls(float* x, float* y, float* vx, float* vy, int n,
+                    glm::vec2 dv, float dt) {
+  kernels->integrate(x, y, vx, vy, n, dv, dt);
+}
+
+int FindBallOutside(const float* x, const float* y, int begin, int n,
+                    float square_radius) {
+  return kernels->find_outside(x, y, begin, n, square_radius);
+}
+
+int FindBallsNear(glm::vec2 p, const float* x, const float* y, int n,
+                  float square_radius, int* out) {
+  return kernels->find_near(p, x, y, n, square_radius, out);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <string_view>
+
+// Kernels over structure-of-arrays ball data. Each has AVX2, SSE and scalar
+// implementations, and the best one supported by the CPU is used unless
+// another is selected with SelectKernels().
+
+// Selects the kernels by name ("avx2", "sse" or "scalar"). Returns false if
+// they are not supported on this machine.
+bool SelectKernels(std::string_view name);
+std::string_view KernelsName();
+
+// Applies the velocity change dv to the first n balls and then moves each of
+// them by its velocity over dt. The arrays must be aligned to kBallAlignment.
+void IntegrateBalls(float* x, float* y, float* vx, float* vy, int n,
+                    glm::vec2 dv, float dt);
+
+// Returns the index of the first of the balls in [begin, n) which is further
+// than sqrt(square_radius) from the origin, or n if there is no such ball.
+int FindBallOutside(const float* x, const float* y, int begin, int n,
+                    float square_radius);
+
+// Writes the index of each of the n candidate positions which is no further
+// than sqrt(square_radius) from p into out, and returns how many there are.
+// This may read up to kBallLanes - 1 elements past the end of x and y, which
+// is always safe for positions within a BallStore.
+int FindBallsNear(glm::vec2 p, const float* x, const float* y, int n,
+                  float square_radius, int* out);
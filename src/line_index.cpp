@@ -0,0 +1,64 @@
+#include "line_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+template <typename F>
+void LineIndex::ForEachCell(const Line& line, float margin, F f) const {
+  // Walk each row of cells which the line passes through, once expanded by the
+  // margin in each direction. Within the row, only the portion of the line
+  // which comes within the margin of the row is considered.
+  const auto cell_of = [&](float x) { return int(std::floor(x / cell_size_)); };
+  const glm::vec2 d = line.b - line.a;
+  const int y_min = cell_of(std::min(line.a.y, line.b.y) - margin);
+  const int y_max = cell_of(std::max(line.a.y, line.b.y) + margin);
+  for (int y = y_min; y <= y_max; y++) {
+    float t_min = 0, t_max = 1;
+    if (d.y != 0) {
+      // The range of t for which the line is within the margin of the row.
+      const float t0 = (y * cell_size_ - margin - line.a.y) / d.y;
+      const float t1 = ((y + 1) * cell_size_ + margin - line.a.y) / d.y;
+      t_min = std::max(t_min, std::min(t0, t1));
+      t_max = std::min(t_max, std::max(t0, t1));
+      if (t_min > t_max) continue;
+    }
+    const float x0 = line.a.x + t_min * d.x, x1 = line.a.x + t_max * d.x;
+    const int x_min = cell_of(std::min(x0, x1) - margin);
+    const int x_max = cell_of(std::max(x0, x1) + margin);
+    for (int x = x_min; x <= x_max; x++) f(BallGrid::Cell{.x = x, .y = y});
+  }
+}
+
+void LineIndex::Add(int id, const Line& line) {
+  ForEachCell(line, margin_, [&](BallGrid::Cell cell) {
+    std::vector<int>& ids = cells_[Key(cell)];
+    ids.insert(std::lower_bound(ids.begin(), ids.end(), id), id);
+  });
+}
+
+void LineIndex::Remove(int id, const Line& line) {
+  ForEachCell(line, margin_, [&](BallGrid::Cell cell) {
+    const auto i = cells_.find(Key(cell));
+    std::erase(i->second, id);
+    if (i->second.empty()) cells_.erase(i);
+  });
+}
+
+void LineIndex::FindCells(const Line& line,
+                          std::vector<BallGrid::Cell>& cells) const {
+  FindCells(line, margin_, cells);
+}
+
+void LineIndex::FindCells(const Line& line, float margin,
+                          std::vector<BallGrid::Cell>& cells) const {
+  ForEachCell(line, margin,
+              [&](BallGrid::Cell cell) { cells.push_back(cell); });
+}
+
+void LineIndex::Rename(int from, int to, const Line& line) {
+  ForEachCell(line, margin_, [&](BallGrid::Cell cell) {
+    std::vector<int>& ids = cells_.find(Key(cell))->second;
+    ids.erase(std::find(ids.begin(), ids.end(), from));
+    ids.insert(std::lower_bound(ids.begin(), ids.end(), to), to);
+  });
+}
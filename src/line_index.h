@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "ball_grid.h"
+
+struct Line {
+  glm::vec2 a, b;
+};
+
+// A persistent index from grid cells to the lines which may touch a ball whose
+// center is in that cell. Each line is listed in exactly the cells which come
+// within margin of it, so long diagonal lines cost time proportional to their
+// length rather than the area of their bounding box. Lines are identified by
+// an integer id chosen by the caller. The ids in each cell are kept in
+// increasing order, so that the index depends only on the lines it holds and
+// not on the order in which they were added, removed and renamed.
+class LineIndex {
+ public:
+  // Uses the same cells as a BallGrid with the given cell size.
+  LineIndex(float cell_size, float margin)
+      : cell_size_(cell_size), margin_(margin) {}
+
+  void Add(int id, const Line& line);
+  void Remove(int id, const Line& line);
+  // Changes the id of a line which was added with id from.
+  void Rename(int from, int to, const Line& line);
+  void Clear() { cells_.clear(); }
+
+  // Appends the cells in which a ball may touch the line to cells.
+  void FindCells(const Line& line, std::vector<BallGrid::Cell>& cells) const;
+  // Appends the cells which come within the given margin of the line.
+  void FindCells(const Line& line, float margin,
+                 std::vector<BallGrid::Cell>& cells) const;
+
+  // Returns the ids of the lines which may touch a ball in the given cell.
+  std::span<const int> Find(BallGrid::Cell cell) const {
+    const auto i = cells_.find(Key(cell));
+    if (i == cells_.end()) return {};
+    return i->second;
+  }
+
+ private:
+  static std::uint64_t Key(BallGrid::Cell cell) {
+    return std::uint64_t(std::uint32_t(cell.x)) << 32 | std::uint32_t(cell.y);
+  }
+
+  // Calls f(cell) for each cell which comes within margin of the line.
+  template <typename F>
+  void ForEachCell(const Line& line, float margin, F f) const;
+
+  const float cell_size_;
+  const float margin_;
+  std::unordered_map<std::uint64_t, std::vector<int>> cells_;
+};
@@ -7,22 +7,56 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <numbers>
 #include <random>
 #include <span>
+#include <sstream>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
-constexpr float kRadius = 1.0f;  // Currently hard-coded in the shader.
+#include "gpu_timer.h"
+#include "hud.h"
+#include "input_log.h"
+#include "polyline.h"
+#include "profiler.h"
+#include "simulation.h"
+#include "stream_buffer.h"
+
+// The initial zoom, in pixels per unit, and the range it may be zoomed over.
 constexpr float kScale = 25.0f;
+constexpr float kMinScale = 0.05f, kMaxScale = 400.0f;
 constexpr float kBoundary = 5000 / kScale;
-constexpr float kDeltaTime = 1.0/240;
-constexpr glm::vec2 kGravity = glm::vec2(0, 50);
+// Below this diameter on screen, in pixels, the balls are drawn as the density
+// of each tile rather than one at a time.
+constexpr float kMinBallPixels = 3.0f;
+// Balls are culled by where they are after the last tick but drawn up to a
+// tick earlier, so the view is widened to allow for that as well as their
+// size.
+constexpr float kCullMargin = 2 * kRadius;
+// Strokes are simplified on release to within this many pixels of what was
+// drawn, and never further than kMaxStrokeError from it, however far out the
+// view is zoomed.
+constexpr float kStrokeErrorPixels = 1.0f;
+constexpr float kMaxStrokeError = 0.1f * kRadius;
+// The emitters added with E pour balls downwards.
+constexpr Emitter kEmitter = {
+    .velocity = glm::vec2(0, 60), .rate = 500, .spread = 0.05f};
 constexpr int kVertex = 0;  // layout(location = 0) in vec2 vertex;
 constexpr int kCenter = 1;  // layout(location = 1) in vec2 center;
+constexpr int kTile = 1;    // layout(location = 1) in vec4 tile;
 constexpr int kMvp = 0;     // layout(binding = 0) uniform MVP { ... }
+constexpr char kScenePath[] = "scene.bin";
 
 [[noreturn]] void Die(std::string_view reason) {
   std::cerr << "Fatal error: " << reason << '\n';
@@ -77,15 +111,6 @@ GLuint LoadShaderProgram(const std::filesystem::path& vertex_shader_path,
   return program;
 }
 
-struct Ball {
-  glm::vec2 position;
-  glm::vec2 velocity;
-};
-
-struct Line {
-  glm::vec2 a, b;
-};
-
 static constexpr float kBox[] = {
   -1.0f, -1.0f,
   -1.0f, 1.0f,
@@ -94,12 +119,62 @@ static constexpr float kBox[] = {
 };
 constexpr int kNumBoxVertices = sizeof(kBox) / (2 * sizeof(float));
 
+// The metrics recorded for each frame while profiling.
+enum FrameMetric {
+  kFrameTime,
+  kDrawTime,
+  kGpuLinesTime,
+  kGpuBallsTime,
+  kDrawnLines,
+  kDrawnBalls,
+  kDrawnTiles,
+};
+constexpr Profiler::Metric kFrameMetrics[] = {
+    {"frame", Profiler::Kind::kTime},
+    {"draw", Profiler::Kind::kTime},
+    {"gpu_lines", Profiler::Kind::kTime},
+    {"gpu_balls", Profiler::Kind::kTime},
+    {"drawn_lines", Profiler::Kind::kCount},
+    {"drawn_balls", Profiler::Kind::kCount},
+    {"drawn_tiles", Profiler::Kind::kCount},
+};
+
+// Appends a line to lines for each metric, summarizing it over the recent
+// frames, with times in microseconds.
+void DescribeProfile(const Profiler& profiler,
+                     std::vector<std::string>& lines) {
+  std::ostringstream header;
+  header << std::left << std::setw(16) << profiler.name() << std::right
+         << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10)
+         << "p95" << std::setw(10) << "p99";
+  lines.push_back(header.str());
+  const std::vector<Profiler::Summary> summaries = profiler.Summarize();
+  for (int m = 0, n = summaries.size(); m < n; m++) {
+    const Profiler::Metric& metric = profiler.metrics()[m];
+    const double scale = metric.kind == Profiler::Kind::kTime ? 1e6 : 1;
+    const Profiler::Summary& summary = summaries[m];
+    std::ostringstream line;
+    line << "  " << std::left << std::setw(14) << metric.name << std::right
+         << std::fixed << std::setprecision(1) << std::setw(10)
+         << summary.mean * scale << std::setw(10) << summary.p50 * scale
+         << std::setw(10) << summary.p95 * scale << std::setw(10)
+         << summary.p99 * scale;
+    lines.push_back(line.str());
+  }
+}
+
 class Game {
  public:
-  Game(GLFWwindow* window)
+  Game(GLFWwindow* window, SimulationOptions options)
       : window_(window),
         ball_shader_(LoadShaderProgram("src/ball.vert", "src/ball.frag")),
-        line_shader_(LoadShaderProgram("src/line.vert", "src/line.frag")) {
+        line_shader_(LoadShaderProgram("src/line.vert", "src/line.frag")),
+        density_shader_(
+            LoadShaderProgram("src/density.vert", "src/density.frag")),
+        sim_([&] {
+          options.world.profiler = &tick_profiler_;
+          return options;
+        }()) {
     glfwSetWindowUserPointer(window_, this);
     glfwSetCursorPosCallback(window_,
                              [](GLFWwindow* window, double x, double y) {
@@ -111,14 +186,20 @@ class Game {
           ((Game*)glfwGetWindowUserPointer(window))
               ->HandleMouseButton(button, action);
         });
+    glfwSetScrollCallback(window_, [](GLFWwindow* window, double x, double y) {
+      ((Game*)glfwGetWindowUserPointer(window))->HandleScroll(y);
+    });
+    glfwSetKeyCallback(window_, [](GLFWwindow* window, int key, int scancode,
+                                   int action, int mods) {
+      ((Game*)glfwGetWindowUserPointer(window))->HandleKey(key, action);
+    });
 
-    GLuint buffers[3];
-    glGenBuffers(3, buffers);
-    auto [box_vertices, mvp, instances] = buffers;
+    GLuint buffers[2];
+    glGenBuffers(2, buffers);
+    auto [box_vertices, mvp] = buffers;
 
     box_vertices_ = box_vertices;
     mvp_ = mvp;
-    instances_ = instances;
 
     glBindBuffer(GL_ARRAY_BUFFER, box_vertices_);
     glBufferData(GL_ARRAY_BUFFER, sizeof(kBox), kBox, GL_STATIC_DRAW);
@@ -127,27 +208,26 @@ class Game {
   ~Game() {
     glfwSetCursorPosCallback(window_, nullptr);
     glfwSetMouseButtonCallback(window_, nullptr);
+    glfwSetScrollCallback(window_, nullptr);
+    glfwSetKeyCallback(window_, nullptr);
     glfwSetWindowUserPointer(window_, nullptr);
   }
 
   void Run() {
-    double time = glfwGetTime();
+    Profiler::Clock::time_point last_frame = Profiler::Clock::now();
     while (!glfwWindowShouldClose(window_)) {
       glfwPollEvents();
       UpdateMatrices();
-
-      const double now = glfwGetTime();
-      const int required_ticks = (now - time) / kDeltaTime;
-      const int bounded_ticks = std::min(6, required_ticks);
-      if (const int missed = required_ticks - bounded_ticks; missed) {
-        std::cerr << "Lag: missed " << missed
-                  << (missed == 1 ? " tick.\n" : " ticks\n.");
+      {
+        Profiler::Scope scope(&frame_profiler_, kDrawTime);
+        Draw();
       }
-      for (int i = 0; i < bounded_ticks; i++) Update();
-      time += kDeltaTime * required_ticks;
-
-      Draw();
       glfwSwapBuffers(window_);
+
+      const Profiler::Clock::time_point now = Profiler::Clock::now();
+      frame_profiler_.AddTime(kFrameTime, last_frame, now);
+      frame_profiler_.EndFrame();
+      last_frame = now;
     }
   }
 
@@ -159,62 +239,249 @@ class Game {
 
     glm::mat4 to_screen =
         glm::translate(glm::vec3(0.5 * width, 0.5 * height, 0)) *
-        glm::scale(glm::vec3(kScale, kScale, 1.0f));
+        glm::scale(glm::vec3(scale_, scale_, 1.0f)) *
+        glm::translate(glm::vec3(-camera_, 0.0f));
     from_screen_ = glm::inverse(to_screen);
     view_ = glm::ortho(0.0f, float(width), float(height), 0.0f, 1.0f, -1.0f) *
             to_screen;
+    view_min_ = ToWorld(glm::vec2(0, 0));
+    view_max_ = ToWorld(glm::vec2(width, height));
+  }
+
+  glm::vec2 ToWorld(glm::vec2 screen) const {
+    return glm::vec2(from_screen_ * glm::vec4(screen, 0.0f, 1.0f));
   }
 
-  void DrawBalls() const {
+  // Finds the rows of tiles in view, with a margin, and returns the number of
+  // balls in them.
+  int FindVisibleBalls(const TileGrid& tiles,
+                       std::vector<TileGrid::Range>& visible) const {
+    const TileGrid::Rect rect = tiles.Cover(view_min_ - kCullMargin,
+                                            view_max_ + kCullMargin);
+    visible.clear();
+    int n = 0;
+    for (int y = rect.y_min; y <= rect.y_max && rect.x_min <= rect.x_max;
+         y++) {
+      const TileGrid::Range row = tiles.FindRow(y, rect.x_min, rect.x_max);
+      if (row.begin == row.end) continue;
+      visible.push_back(row);
+      n += row.end - row.begin;
+    }
+    return n;
+  }
+
+  void DrawBalls(const Simulation::Snapshot& snapshot) {
+    // Find the awake and sleeping balls in view. They are sorted by tile, so
+    // the balls in each row of tiles in view are contiguous.
+    const Simulation::SleepingBalls& sleeping = *snapshot.sleeping;
+    const int n = FindVisibleBalls(snapshot.ball_tiles, visible_) +
+                  FindVisibleBalls(sleeping.tiles, visible_sleeping_);
+    frame_profiler_.Add(kDrawnBalls, n);
+    if (n == 0) return;
+
     // Select the box vertex buffer.
     glBindBuffer(GL_ARRAY_BUFFER, box_vertices_);
     glEnableVertexAttribArray(kVertex);
     glVertexAttribPointer(kVertex, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
 
-    // Load the instance data for all balls.
-    std::vector<glm::vec2> instances;
-    instances.reserve(balls_.size());
-    for (const Ball& ball : balls_) instances.push_back(ball.position);
-    glBindBuffer(GL_ARRAY_BUFFER, instances_);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * instances.size(),
-                 instances.data(), GL_DYNAMIC_DRAW);
+    // Write the instance data for all balls straight into the mapped buffer.
+    // The awake balls are drawn one tick behind the simulation, interpolating
+    // between the last two ticks so that motion is smooth regardless of how
+    // the frame rate and the tick rate line up.
+    const float alpha = std::clamp(
+        std::chrono::duration<float>(Simulation::Clock::now() - snapshot.time) /
+            sim_.tick(),
+        0.0f, 1.0f);
+    glm::vec2* instance = ball_instances_.Map<glm::vec2>(n);
+    for (const TileGrid::Range& row : visible_) {
+      for (int i = row.begin; i < row.end; i++) {
+        *instance++ =
+            glm::mix(snapshot.previous[i], snapshot.current[i], alpha);
+      }
+    }
+    for (const TileGrid::Range& row : visible_sleeping_) {
+      instance = std::copy(sleeping.positions.begin() + row.begin,
+                           sleeping.positions.begin() + row.end, instance);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, ball_instances_.buffer());
     glEnableVertexAttribArray(kCenter);
-    glVertexAttribPointer(kCenter, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glVertexAttribPointer(kCenter, 2, GL_FLOAT, GL_FALSE, 0,
+                          (const void*)ball_instances_.offset());
     glVertexAttribDivisor(kCenter, 1);
 
     // Draw all the balls.
     glUseProgram(ball_shader_);
-    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, kNumBoxVertices,
-                          instances.size());
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, kNumBoxVertices, n);
+    ball_instances_.Fence();
 
     // Disable the vertex arrays again.
     glDisableVertexAttribArray(kVertex);
     glDisableVertexAttribArray(kCenter);
   }
 
-  void DrawLines() const {
-    // Load the vertices for all lines.
-    std::vector<glm::vec2> vertices;
-    vertices.reserve(2 * lines_.size());
-    for (const Line& line : lines_) {
-      vertices.push_back(line.a);
-      vertices.push_back(line.b);
+  // Draws each tile of balls in view as a square, shaded by the fraction of
+  // it which the balls cover. This costs the same however many balls there
+  // are, for when they are too small to draw one at a time. The awake and
+  // sleeping balls have tiles of their own, which are blended where they
+  // overlap.
+  void DrawDensity(const Simulation::Snapshot& snapshot) {
+    const TileGrid* const grids[] = {&snapshot.ball_tiles,
+                                     &snapshot.sleeping->tiles};
+    TileGrid::Rect rects[2];
+    int capacity = 0;
+    for (int k = 0; k < 2; k++) {
+      rects[k] = grids[k]->Cover(view_min_, view_max_);
+      const TileGrid::Rect& rect = rects[k];
+      if (rect.x_min > rect.x_max || rect.y_min > rect.y_max) continue;
+      capacity += (rect.x_max - rect.x_min + 1) * (rect.y_max - rect.y_min + 1);
+    }
+    if (capacity == 0) return;
+
+    // Write a center, half-size and density for each occupied tile.
+    glm::vec4* const instances = tile_instances_.Map<glm::vec4>(capacity);
+    int n = 0;
+    for (int k = 0; k < 2; k++) {
+      const TileGrid& tiles = *grids[k];
+      const TileGrid::Rect& rect = rects[k];
+      const float size = tiles.tile_size();
+      const float ball_density =
+          std::numbers::pi_v<float> * kRadius * kRadius / (size * size);
+      for (int y = rect.y_min; y <= rect.y_max; y++) {
+        for (int x = rect.x_min; x <= rect.x_max; x++) {
+          const int count = tiles.count(x, y);
+          if (count == 0) continue;
+          const glm::vec2 center = tiles.tile_min(x, y) + 0.5f * size;
+          instances[n++] = glm::vec4(center, 0.5f * size,
+                                     std::min(1.0f, count * ball_density));
+        }
+      }
     }
-    glBindBuffer(GL_ARRAY_BUFFER, instances_);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * vertices.size(),
-                 vertices.data(), GL_DYNAMIC_DRAW);
+    frame_profiler_.Add(kDrawnTiles, n);
+    if (n == 0) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, box_vertices_);
     glEnableVertexAttribArray(kVertex);
     glVertexAttribPointer(kVertex, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glBindBuffer(GL_ARRAY_BUFFER, tile_instances_.buffer());
+    glEnableVertexAttribArray(kTile);
+    glVertexAttribPointer(kTile, 4, GL_FLOAT, GL_FALSE, 0,
+                          (const void*)tile_instances_.offset());
+    glVertexAttribDivisor(kTile, 1);
+
+    glUseProgram(density_shader_);
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, kNumBoxVertices, n);
+    tile_instances_.Fence();
+
+    glDisableVertexAttribArray(kVertex);
+    glDisableVertexAttribArray(kTile);
+  }
+
+  // Brings the line vertex buffer up to date with the world. Lines are almost
+  // always appended, in which case only the new ones are uploaded.
+  void UpdateLineVertices(const Simulation::Snapshot& snapshot) {
+    static_assert(sizeof(Line) == 2 * sizeof(glm::vec2));
+    const std::vector<Line>& lines = *snapshot.lines;
+    const int n = lines.size();
+    if (snapshot.lines_version != lines_version_ || n > line_capacity_) {
+      if (n > line_capacity_) {
+        if (line_vertices_) glDeleteBuffers(1, &line_vertices_);
+        line_capacity_ = std::max(1024, int(std::bit_ceil(unsigned(n))));
+        glGenBuffers(1, &line_vertices_);
+        glBindBuffer(GL_ARRAY_BUFFER, line_vertices_);
+        glBufferStorage(GL_ARRAY_BUFFER, line_capacity_ * sizeof(Line),
+                        nullptr, GL_DYNAMIC_STORAGE_BIT);
+      }
+      lines_version_ = snapshot.lines_version;
+      num_line_vertices_ = 0;
+    }
+    if (const int uploaded = num_line_vertices_ / 2; n > uploaded) {
+      glBindBuffer(GL_ARRAY_BUFFER, line_vertices_);
+      glBufferSubData(GL_ARRAY_BUFFER, uploaded * sizeof(Line),
+                      (n - uploaded) * sizeof(Line), lines.data() + uploaded);
+      num_line_vertices_ = 2 * n;
+    }
+  }
+
+  // Finds the lines which pass through the tiles in view, and writes the
+  // indices of their vertices to line_indices_. Returns false if there are
+  // more tiles in view than lines, in which case every line is drawn instead.
+  bool FindVisibleLines(const Simulation::Snapshot& snapshot) {
+    const auto tile = [](float x) {
+      return std::floor(x / Simulation::kLineTileSize);
+    };
+    const glm::vec2 min(tile(view_min_.x), tile(view_min_.y));
+    const glm::vec2 max(tile(view_max_.x), tile(view_max_.y));
+    const int num_lines = snapshot.lines->size();
+    if ((max.x - min.x + 1) * (max.y - min.y + 1) > num_lines) return false;
+
+    // A line may pass through several tiles, so each line is marked with the
+    // frame in which it was last found.
+    if (int(line_marks_.size()) < num_lines) line_marks_.resize(num_lines);
+    line_frame_++;
+    line_indices_.clear();
+    for (int y = min.y; y <= max.y; y++) {
+      for (int x = min.x; x <= max.x; x++) {
+        for (int id : snapshot.line_tiles->Find(
+                 BallGrid::Cell{.x = x, .y = y})) {
+          if (line_marks_[id] == line_frame_) continue;
+          line_marks_[id] = line_frame_;
+          line_indices_.push_back(2 * id);
+          line_indices_.push_back(2 * id + 1);
+        }
+      }
+    }
+    return true;
+  }
 
-    // Draw all the lines.
+  void DrawLines(const Simulation::Snapshot& snapshot) {
+    UpdateLineVertices(snapshot);
+    if (num_line_vertices_ == 0) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, line_vertices_);
+    glEnableVertexAttribArray(kVertex);
+    glVertexAttribPointer(kVertex, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    // Draw the lines in view, or all of them if that is cheaper.
     glUseProgram(line_shader_);
-    glDrawArrays(GL_LINES, 0, vertices.size());
+    if (FindVisibleLines(snapshot)) {
+      const int n = line_indices_.size();
+      frame_profiler_.Add(kDrawnLines, n / 2);
+      if (n > 0) {
+        std::copy(line_indices_.begin(), line_indices_.end(),
+                  line_index_buffer_.Map<GLuint>(n));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, line_index_buffer_.buffer());
+        glDrawElements(GL_LINES, n, GL_UNSIGNED_INT,
+                       (const void*)line_index_buffer_.offset());
+        line_index_buffer_.Fence();
+      }
+    } else {
+      frame_profiler_.Add(kDrawnLines, num_line_vertices_ / 2);
+      glDrawArrays(GL_LINES, 0, num_line_vertices_);
+    }
 
     // Disable the vertex array.
     glDisableVertexAttribArray(kVertex);
   }
 
-  void Draw() const {
+  // Draws the stroke being drawn, which only becomes lines on release.
+  void DrawStroke() {
+    if (!drawing_) return;
+    const int n = stroke_.size() + 1;
+    glm::vec2* const vertices = stroke_vertices_.Map<glm::vec2>(n);
+    std::copy(stroke_.begin(), stroke_.end(), vertices);
+    vertices[n - 1] = mouse_;
+
+    glBindBuffer(GL_ARRAY_BUFFER, stroke_vertices_.buffer());
+    glEnableVertexAttribArray(kVertex);
+    glVertexAttribPointer(kVertex, 2, GL_FLOAT, GL_FALSE, 0,
+                          (const void*)stroke_vertices_.offset());
+    glUseProgram(line_shader_);
+    glDrawArrays(GL_LINE_STRIP, 0, n);
+    stroke_vertices_.Fence();
+    glDisableVertexAttribArray(kVertex);
+  }
+
+  void Draw() {
     glClear(GL_COLOR_BUFFER_BIT);
 
     struct {
@@ -222,186 +489,228 @@ class Game {
     } mvp;
     mvp.matrix = view_;
 
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(mvp), &mvp, GL_DYNAMIC_DRAW);
     glBindBuffer(GL_UNIFORM_BUFFER, mvp_);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(mvp), &mvp, GL_DYNAMIC_DRAW);
     glBindBufferBase(GL_UNIFORM_BUFFER, kMvp, mvp_);
 
-    DrawLines();
-    DrawBalls();
-  }
-
-  void Update() {
-    // Update the balls according to gravity.
-    for (Ball& ball : balls_) {
-      ball.velocity += kGravity * kDeltaTime;
-      ball.position += ball.velocity * kDeltaTime;
+    const Simulation::Snapshot& snapshot = sim_.Latest();
+    const bool profiling = frame_profiler_.enabled();
+    // GPU times arrive a few frames late, so they are added to whichever
+    // frame is current when they do.
+    if (profiling) {
+      if (const auto time = line_timer_.Begin()) {
+        frame_profiler_.Add(kGpuLinesTime, *time);
+      }
     }
-
-    // Remove balls which have moved far away from the origin.
-    std::erase_if(balls_, [](const Ball& ball) {
-      return glm::dot(ball.position, ball.position) > kBoundary * kBoundary;
-    });
-
-    // Randomly shuffle all balls and lines to prevent the order from mattering.
-    std::shuffle(balls_.begin(), balls_.end(), gen_);
-    std::shuffle(lines_.begin(), lines_.end(), gen_);
-
-    constexpr double kCellSize = 2 * kRadius;
-    constexpr int kGridRadius = 1 + std::ceil(kBoundary / kCellSize);
-    constexpr int kGridSize = 4 * kGridRadius * kGridRadius;
-
-    constexpr int kMaxCellSize = 15;
-    struct Cell {
-      void push_back(std::uint16_t x) {
-        if (size == kMaxCellSize) throw std::runtime_error("Cell overflowed.");
-        data[size++] = x;
+    DrawLines(snapshot);
+    DrawStroke();
+    if (profiling) {
+      line_timer_.End();
+      if (const auto time = ball_timer_.Begin()) {
+        frame_profiler_.Add(kGpuBallsTime, *time);
       }
-
-      std::uint16_t* begin() { return data; }
-      std::uint16_t* end() { return data + size; }
-
-      std::uint16_t size = 0;
-      std::uint16_t data[kMaxCellSize];
-    };
-
-    std::vector<Cell> balls(kGridSize);
-
-    struct Point { int x, y, i; };
-    static constexpr auto cell = [](glm::vec2 position) {
-      const int x = int(position.x / kCellSize) + kGridRadius;
-      const int y = int(position.y / kCellSize) + kGridRadius;
-      const int i = y * 2 * kGridRadius + x;
-      return Point{.x = x, .y = y, .i = i};
-    };
-
-    for (int i = 0, n = balls_.size(); i < n; i++) {
-      const Ball& b = balls_[i];
-      const Point p = cell(b.position);
-      balls[p.i].push_back(i);
     }
+    if (scale_ * 2 * kRadius < kMinBallPixels) {
+      DrawDensity(snapshot);
+    } else {
+      DrawBalls(snapshot);
+    }
+    if (profiling) {
+      ball_timer_.End();
+      DrawProfile();
+    }
+  }
 
-    // Check for collisions between lines and balls.
-    for (const Line& line : lines_) {
-      const glm::vec2 d = line.b - line.a;
-      const Point a = cell(line.a);
-      const Point b = cell(line.b);
-      const int x_min = std::min(a.x, b.x) - 1;
-      const int x_max = std::max(a.x, b.x) + 1;
-      const int y_min = std::min(a.y, b.y) - 1;
-      const int y_max = std::max(a.y, b.y) + 1;
-      for (int y = y_min; y <= y_max; y++) {
-        for (int x = x_min; x <= x_max; x++) {
-          for (int ball_index : balls[2 * kGridRadius * y + x]) {
-            Ball& ball = balls_[ball_index];
-
-            // Check for a collision.
-            const glm::vec2 v = ball.position - line.a;
-            const float t =
-                std::clamp(glm::dot(d, v) / glm::dot(d, d), 0.0f, 1.0f);
-            const glm::vec2 p = line.a + t * d;
-            const glm::vec2 offset = ball.position - p;
-            const float square_distance = glm::dot(offset, offset);
-            if (square_distance > kRadius * kRadius) continue;
-
-            // Handle the collision.
-            const float overlap = kRadius - std::sqrt(square_distance);
-            const glm::vec2 normal = glm::normalize(offset);
-            ball.position += 0.8f * overlap * normal;
-            const float separation_speed = glm::dot(ball.velocity, normal);
-            if (separation_speed < 0) {
-              ball.velocity -= 1.8f * separation_speed * normal;
-            }
-          }
-        }
+  void DrawProfile() {
+    std::vector<std::string> lines;
+    DescribeProfile(tick_profiler_, lines);
+    DescribeProfile(frame_profiler_, lines);
+    lines.push_back(tracing_ ? "tracing - press t to stop"
+                             : "press t to trace");
+    int width, height;
+    glfwGetFramebufferSize(window_, &width, &height);
+    hud_.Draw(lines, width, height);
+  }
+
+  // P toggles the profiler and its overlay. While the profiler is enabled, T
+  // starts and stops a trace, which is written to trace.json in the Chrome
+  // trace format, and to ticks.csv and frames.csv. F5 saves the scene to
+  // kScenePath and F9 loads it again. E adds an emitter at the cursor. Home
+  // resets the camera.
+  void HandleKey(int key, int action) {
+    if (action != GLFW_PRESS) return;
+    if (key == GLFW_KEY_HOME) {
+      camera_ = glm::vec2();
+      scale_ = kScale;
+    } else if (key == GLFW_KEY_E) {
+      Emitter emitter = kEmitter;
+      emitter.position = mouse_;
+      sim_.Send(emitter);
+    } else if (key == GLFW_KEY_F5) {
+      sim_.Save(kScenePath);
+    } else if (key == GLFW_KEY_F9) {
+      sim_.Load(kScenePath);
+    } else if (key == GLFW_KEY_P) {
+      if (tracing_) StopTrace();
+      const bool enabled = !frame_profiler_.enabled();
+      frame_profiler_.set_enabled(enabled);
+      tick_profiler_.set_enabled(enabled);
+    } else if (key == GLFW_KEY_T && frame_profiler_.enabled()) {
+      if (tracing_) {
+        StopTrace();
+      } else {
+        tick_profiler_.StartTrace();
+        frame_profiler_.StartTrace();
+        tracing_ = true;
       }
     }
+  }
 
-    // Check for collisions between balls.
-    int n = balls_.size();
-    for (int i = 0; i < n; i++) {
-      Ball& a = balls_[i];
-      const Point p = cell(a.position);
-      const int x_min = p.x - 1;
-      const int x_max = p.x + 1;
-      const int y_min = p.y - 1;
-      const int y_max = p.y + 1;
-      for (int y = y_min; y <= y_max; y++) {
-        for (int x = x_min; x <= x_max; x++) {
-          for (int ball_index : balls[2 * kGridRadius * y + x]) {
-            if (ball_index == i) continue;
-
-            // Check for a collision.
-            Ball& b = balls_[ball_index];
-            const glm::vec2 offset = b.position - a.position;
-            const float square_distance = glm::dot(offset, offset);
-            if (square_distance > 4 * kRadius * kRadius) continue;
-
-            // Handle the collision.
-            const float overlap = 2 * kRadius - std::sqrt(square_distance);
-            const glm::vec2 normal = glm::normalize(offset);
-            a.position -= 0.4f * overlap * normal;
-            b.position += 0.4f * overlap * normal;
-            const float separation_speed =
-                glm::dot(b.velocity - a.velocity, normal);
-            if (separation_speed < 0) {
-              const glm::vec2 correction = 0.9f * separation_speed * normal;
-              a.velocity += correction;
-              b.velocity -= correction;
-            }
-          }
-        }
-      }
+  void StopTrace() {
+    tick_profiler_.StopTrace();
+    frame_profiler_.StopTrace();
+    tracing_ = false;
+    const Profiler* const profilers[] = {&tick_profiler_, &frame_profiler_};
+    if (!Profiler::WriteChromeTrace("trace.json", profilers) ||
+        !tick_profiler_.WriteCsv("ticks.csv") ||
+        !frame_profiler_.WriteCsv("frames.csv")) {
+      std::cerr << "Failed to write the trace.\n";
+      return;
     }
+    std::cerr << "Wrote trace.json, ticks.csv and frames.csv.\n";
+  }
+
+  // Zooms in or out, keeping the point under the cursor where it is.
+  void HandleScroll(double offset) {
+    const float scale =
+        std::clamp(scale_ * std::pow(1.1f, float(offset)), kMinScale,
+                   kMaxScale);
+    camera_ = mouse_ + (camera_ - mouse_) * (scale_ / scale);
+    scale_ = scale;
   }
 
   void HandleMouseMove(glm::vec2 position) {
-    mouse_ = glm::vec2(from_screen_ * glm::vec4(position, 0.0f, 1.0f));
-    if (drawing_ && glm::distance(line_start_, mouse_) > 0.1) {
-      lines_.push_back(Line{.a = line_start_, .b = mouse_});
-      line_start_ = mouse_;
+    // Dragging with the middle button pans the camera.
+    if (panning_) camera_ -= (position - cursor_) / scale_;
+    cursor_ = position;
+    mouse_ = ToWorld(position);
+    if (drawing_ && glm::distance(stroke_.back(), mouse_) > 0.1) {
+      stroke_.push_back(mouse_);
     }
   }
 
+  // Sends the stroke as lines, with as few segments as keep it within the
+  // error allowed. The segments share their ends exactly, so that balls roll
+  // smoothly from one to the next.
+  void FinishStroke() {
+    if (glm::distance(stroke_.back(), mouse_) > 0.01) {
+      stroke_.push_back(mouse_);
+    }
+    std::vector<glm::vec2> points = SimplifyPolyline(
+        stroke_, std::min(kMaxStrokeError, kStrokeErrorPixels / scale_));
+    MergeCollinear(points);
+    for (int i = 1, n = points.size(); i < n; i++) {
+      sim_.Send(Line{.a = points[i - 1], .b = points[i]});
+    }
+    stroke_.clear();
+  }
+
   void HandleMouseButton(int button, int action) {
-    if (button == GLFW_MOUSE_BUTTON_RIGHT) {
+    if (button == GLFW_MOUSE_BUTTON_MIDDLE) {
+      panning_ = action == GLFW_PRESS;
+    } else if (button == GLFW_MOUSE_BUTTON_RIGHT) {
       if (action == GLFW_PRESS) {
-        line_start_ = mouse_;
+        stroke_.assign(1, mouse_);
         drawing_ = true;
-      } else if (action == GLFW_RELEASE) {
-        if (glm::distance(line_start_, mouse_) > 0.01) {
-          lines_.push_back(Line{.a = line_start_, .b = mouse_});
-        }
+      } else if (action == GLFW_RELEASE && drawing_) {
+        FinishStroke();
         drawing_ = false;
       }
     } else if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
-      balls_.push_back(Ball{.position = mouse_});
+      sim_.Send(Ball{.position = mouse_});
     }
   }
 
-  std::ranlux24 gen_{std::random_device()()};
   GLFWwindow* const window_;
   const GLuint ball_shader_;
   const GLuint line_shader_;
+  const GLuint density_shader_;
   GLuint box_vertices_;
-  GLuint line_vertices_;
-  GLuint mvp_, instances_;
-  std::vector<Ball> balls_;
-  std::vector<Line> lines_;
+  GLuint mvp_;
+  StreamBuffer ball_instances_;
+  StreamBuffer tile_instances_;
+  StreamBuffer line_index_buffer_;
+  StreamBuffer stroke_vertices_;
+  Hud hud_{line_shader_};
+  GpuTimer line_timer_, ball_timer_;
+
+  // Line vertices, which are only uploaded when the lines change.
+  GLuint line_vertices_ = 0;
+  int line_capacity_ = 0;
+  int num_line_vertices_ = 0;
+  std::uint64_t lines_version_ = 0;
+  // Scratch space for culling.
+  std::vector<TileGrid::Range> visible_, visible_sleeping_;
+  std::vector<GLuint> line_indices_;
+  std::vector<std::uint32_t> line_marks_;
+  std::uint32_t line_frame_ = 0;
+  // The profilers are disabled until P is pressed.
+  Profiler tick_profiler_{"world", kWorldMetrics, 240};
+  Profiler frame_profiler_{"frame", kFrameMetrics, 120};
+  bool tracing_ = false;
+  Simulation sim_;
+  // The camera: the point at the center of the screen, and the zoom in pixels
+  // per unit. The view is the rectangle of the world on screen.
+  glm::vec2 camera_ = glm::vec2();
+  float scale_ = kScale;
   glm::mat4 view_, from_screen_;
+  glm::vec2 view_min_, view_max_;
+  bool panning_ = false;
+  glm::vec2 cursor_ = glm::vec2();
 
   // Drawing state.
   bool drawing_ = false;
-  glm::vec2 line_start_;
+  std::vector<glm::vec2> stroke_;
   glm::vec2 mouse_ = glm::vec2();
 };
 
-int main() {
+// Usage: game [--seed=N] [--rate=N] [--record=FILE | --replay=FILE]
+//
+// --rate sets the number of ticks per second, which defaults to 240. Lower
+// rates cost less, and fast balls are swept so they still cannot tunnel.
+// --record writes every edit to an input log when the game exits, and
+// --replay plays one back as fast as possible, without vsync, to reproduce
+// exactly the same world.
+int main(int argc, char* argv[]) {
+  SimulationOptions options{
+      .world = {.seed = std::random_device()(),
+                .threads = int(std::thread::hardware_concurrency()),
+                .kill_radius = kBoundary,
+                .sleep = true}};
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--seed=")) {
+      options.world.seed = std::stoul(std::string(arg.substr(7)));
+    } else if (arg.starts_with("--rate=")) {
+      options.world.tick_rate = std::stoi(std::string(arg.substr(7)));
+      if (options.world.tick_rate <= 0) Die("the tick rate must be positive");
+    } else if (arg.starts_with("--record=")) {
+      options.record = arg.substr(9);
+    } else if (arg.starts_with("--replay=")) {
+      options.replay = InputLog::Read(arg.substr(9));
+      if (!options.replay) Die("failed to read the input log");
+    } else {
+      Die("unknown argument");
+    }
+  }
+
   if (!glfwInit()) Die("glfwInit");
   GLFWwindow* window = glfwCreateWindow(640, 480, "Game", nullptr, nullptr);
   if (!window) Die("glfwCreateWindow");
   glfwMakeContextCurrent(window);
-  glfwSwapInterval(1);
+  glfwSwapInterval(options.replay ? 0 : 1);
   if (!gladLoadGL(glfwGetProcAddress)) Die("gladLoadGL");
+  if (!GLAD_GL_VERSION_4_4) Die("OpenGL 4.4 is required");
 
   GLuint vertex_array;
   glGenVertexArrays(1, &vertex_array);
@@ -411,6 +720,6 @@ int main() {
   glEnable(GL_BLEND);
   glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
-  Game game(window);
+  Game game(window, std::move(options));
   game.Run();
 }
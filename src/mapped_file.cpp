@@ -0,0 +1,34 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() { Close(); }
+
+bool MappedFile::Open(const std::filesystem::path& path) {
+  Close();
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) return false;
+  struct stat status;
+  bool ok = fstat(fd, &status) == 0;
+  // An empty file cannot be mapped, but has nothing to read anyway.
+  if (ok && status.st_size > 0) {
+    void* const data =
+        mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ok = data != MAP_FAILED;
+    if (ok) {
+      data_ = static_cast<const std::byte*>(data);
+      size_ = status.st_size;
+    }
+  }
+  close(fd);
+  return ok;
+}
+
+void MappedFile::Close() {
+  if (data_) munmap(const_cast<std::byte*>(data_), size_);
+  data_ = nullptr;
+  size_ = 0;
+}
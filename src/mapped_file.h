@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+// A whole file mapped read-only into memory, so that it can be read without
+// copying it through a buffer first.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Maps the file, replacing any file which was mapped before. Returns false
+  // if it could not be opened or mapped.
+  bool Open(const std::filesystem::path& path);
+
+  // The contents of the file, which remain valid until it is closed.
+  std::span<const std::byte> bytes() const { return {data_, size_}; }
+
+  void Close();
+
+ private:
+  const std::byte* data_ = nullptr;
+  std::size_t size_ = 0;
+};
@@ -0,0 +1,82 @@
+#include "polyline.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// The largest sine of the angle between two segments for which they count as
+// collinear.
+constexpr float kCollinearSine = 1e-4f;
+
+// Returns the distance from p to the segment from a to b.
+float Distance(glm::vec2 p, glm::vec2 a, glm::vec2 b) {
+  const glm::vec2 d = b - a;
+  const float square_length = glm::dot(d, d);
+  if (square_length == 0) return glm::distance(p, a);
+  const float t = std::clamp(glm::dot(p - a, d) / square_length, 0.0f, 1.0f);
+  return glm::distance(p, a + t * d);
+}
+
+}  // namespace
+
+std::vector<glm::vec2> SimplifyPolyline(std::span<const glm::vec2> points,
+                                        float tolerance) {
+  const int n = points.size();
+  if (n <= 2) return std::vector<glm::vec2>(points.begin(), points.end());
+
+  // Keep the point furthest from the segment between the ends of each span
+  // if it is too far away, and split the span there. Spans are kept on an
+  // explicit stack since a long stroke could otherwise recurse deeply.
+  std::vector<char> keep(n, false);
+  keep[0] = keep[n - 1] = true;
+  struct Span {
+    int first, last;
+  };
+  std::vector<Span> spans = {{0, n - 1}};
+  while (!spans.empty()) {
+    const auto [first, last] = spans.back();
+    spans.pop_back();
+    float furthest_distance = tolerance;
+    int furthest = -1;
+    for (int i = first + 1; i < last; i++) {
+      const float distance = Distance(points[i], points[first], points[last]);
+      if (distance > furthest_distance) {
+        furthest_distance = distance;
+        furthest = i;
+      }
+    }
+    if (furthest == -1) continue;
+    keep[furthest] = true;
+    spans.push_back({first, furthest});
+    spans.push_back({furthest, last});
+  }
+
+  std::vector<glm::vec2> simplified;
+  for (int i = 0; i < n; i++) {
+    if (keep[i]) simplified.push_back(points[i]);
+  }
+  return simplified;
+}
+
+void MergeCollinear(std::vector<glm::vec2>& points) {
+  // Build the result in place, dropping each point between two segments
+  // which continue in the same direction.
+  int n = 0;
+  for (const glm::vec2 p : points) {
+    if (n > 0 && p == points[n - 1]) continue;
+    if (n >= 2) {
+      const glm::vec2 d0 = points[n - 1] - points[n - 2];
+      const glm::vec2 d1 = p - points[n - 1];
+      const float cross = d0.x * d1.y - d0.y * d1.x;
+      if (glm::dot(d0, d1) > 0 &&
+          std::abs(cross) <=
+              kCollinearSine * glm::length(d0) * glm::length(d1)) {
+        points[n - 1] = p;
+        continue;
+      }
+    }
+    points[n++] = p;
+  }
+  points.resize(n);
+}
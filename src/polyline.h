@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <span>
+#include <vector>
+
+// Simplifies a polyline by the Douglas-Peucker algorithm, returning a subset
+// of its points which includes both ends, such that every point left out is
+// within tolerance of the simplified polyline.
+std::vector<glm::vec2> SimplifyPolyline(std::span<const glm::vec2> points,
+                                        float tolerance);
+
+// Merges each pair of adjacent segments which run in the same direction along
+// the same line, to within rounding, into one segment, and removes repeated
+// points. Segments which double back are never merged.
+void MergeCollinear(std::vector<glm::vec2>& points);
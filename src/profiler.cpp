@@ -0,0 +1,152 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+Profiler::Profiler(std::string_view name, std::span<const Metric> metrics,
+                   int window_size)
+    : name_(name), metrics_(metrics), window_size_(window_size) {
+  current_.start = Clock::now();
+  current_.values.resize(metrics_.size());
+}
+
+void Profiler::Add(int metric, double value) {
+  if (!enabled()) return;
+  current_.values[metric] += value;
+}
+
+void Profiler::AddTime(int metric, Clock::time_point start,
+                       Clock::time_point end) {
+  if (!enabled()) return;
+  current_.values[metric] += std::chrono::duration<double>(end - start).count();
+  current_.spans.push_back(Span{.metric = metric, .start = start, .end = end});
+}
+
+void Profiler::EndFrame() {
+  if (enabled()) {
+    std::lock_guard lock(mutex_);
+    if (tracing_) trace_.push_back(current_);
+    if (int(window_.size()) < window_size_) {
+      window_.push_back(current_);
+    } else {
+      window_[next_] = current_;
+    }
+    next_ = (next_ + 1) % window_size_;
+  }
+  current_.start = Clock::now();
+  std::fill(current_.values.begin(), current_.values.end(), 0);
+  current_.spans.clear();
+}
+
+std::vector<Profiler::Summary> Profiler::Summarize() const {
+  std::lock_guard lock(mutex_);
+  std::vector<Summary> summaries(metrics_.size());
+  const int n = window_.size();
+  if (n == 0) return summaries;
+  std::vector<double> values(n);
+  for (int m = 0, num_metrics = metrics_.size(); m < num_metrics; m++) {
+    double total = 0;
+    for (int i = 0; i < n; i++) total += values[i] = window_[i].values[m];
+    std::sort(values.begin(), values.end());
+    const auto percentile = [&](int p) { return values[(n - 1) * p / 100]; };
+    summaries[m] = Summary{.mean = total / n,
+                           .p50 = percentile(50),
+                           .p95 = percentile(95),
+                           .p99 = percentile(99)};
+  }
+  return summaries;
+}
+
+void Profiler::StartTrace() {
+  std::lock_guard lock(mutex_);
+  trace_.clear();
+  tracing_ = true;
+}
+
+void Profiler::StopTrace() {
+  std::lock_guard lock(mutex_);
+  tracing_ = false;
+}
+
+bool Profiler::WriteCsv(const std::filesystem::path& path) const {
+  std::lock_guard lock(mutex_);
+  std::ofstream file(path);
+  file << std::fixed << std::setprecision(3) << "frame,start";
+  for (const Metric& metric : metrics_) file << ',' << metric.name;
+  file << '\n';
+  for (int i = 0, n = trace_.size(); i < n; i++) {
+    const Frame& frame = trace_[i];
+    file << i << ',' << std::setprecision(3)
+         << std::chrono::duration<double, std::micro>(frame.start -
+                                                       trace_[0].start)
+                .count();
+    for (int m = 0, num_metrics = metrics_.size(); m < num_metrics; m++) {
+      if (metrics_[m].kind == Kind::kTime) {
+        file << ',' << std::setprecision(3) << frame.values[m] * 1e6;
+      } else {
+        file << ',' << std::setprecision(0) << frame.values[m];
+      }
+    }
+    file << '\n';
+  }
+  return file.good();
+}
+
+bool Profiler::WriteChromeTrace(const std::filesystem::path& path,
+                                std::span<const Profiler* const> profilers) {
+  std::vector<std::unique_lock<std::mutex>> locks;
+  Clock::time_point origin = Clock::time_point::max();
+  for (const Profiler* profiler : profilers) {
+    locks.emplace_back(profiler->mutex_);
+    if (!profiler->trace_.empty()) {
+      origin = std::min(origin, profiler->trace_.front().start);
+    }
+  }
+  const auto micros = [&](Clock::time_point time) {
+    return std::chrono::duration<double, std::micro>(time - origin).count();
+  };
+
+  // Each time which was recorded with a start becomes a complete event, and
+  // every other metric becomes a counter at the start of its frame. Times
+  // which were not recorded at all in a frame are left out.
+  std::ofstream file(path);
+  file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+  const char* separator = "";
+  for (int tid = 0, n = profilers.size(); tid < n; tid++) {
+    const Profiler& profiler = *profilers[tid];
+    file << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+         << "\"tid\":" << tid << ",\"args\":{\"name\":\"" << profiler.name_
+         << "\"}}";
+    separator = ",\n";
+    std::vector<char> spanned(profiler.metrics_.size());
+    for (const Frame& frame : profiler.trace_) {
+      std::fill(spanned.begin(), spanned.end(), false);
+      for (const Span& span : frame.spans) {
+        file << separator << "{\"name\":\""
+             << profiler.metrics_[span.metric].name
+             << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+             << ",\"ts\":" << micros(span.start) << ",\"dur\":"
+             << std::chrono::duration<double, std::micro>(span.end - span.start)
+                    .count()
+             << '}';
+        spanned[span.metric] = true;
+      }
+      for (int m = 0, num_metrics = profiler.metrics_.size(); m < num_metrics;
+           m++) {
+        const Metric& metric = profiler.metrics_[m];
+        const double value = frame.values[m];
+        if (spanned[m]) continue;
+        if (metric.kind == Kind::kCount || value != 0) {
+          file << separator << "{\"name\":\"" << metric.name
+               << "\",\"ph\":\"C\",\"pid\":1,\"tid\":" << tid
+               << ",\"ts\":" << micros(frame.start) << ",\"args\":{\""
+               << metric.name << "\":"
+               << (metric.kind == Kind::kTime ? value * 1e6 : value) << "}}";
+        }
+      }
+    }
+  }
+  file << "\n]}\n";
+  return file.good();
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Records a fixed set of metrics once per frame, where a frame is whatever
+// unit of work the owner repeats, such as a simulation tick. Each metric is
+// either a duration, in seconds, or a count. The last window_size frames are
+// kept for summaries, and every frame is kept while a trace is running.
+//
+// The metrics for the current frame are recorded by a single thread, but
+// summaries and traces may be taken from any thread. When the profiler is
+// disabled, Scope and Add() do nothing, and callers may skip collecting
+// metrics altogether by checking enabled().
+class Profiler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Kind { kTime, kCount };
+  struct Metric {
+    std::string_view name;
+    Kind kind;
+  };
+
+  Profiler(std::string_view name, std::span<const Metric> metrics,
+           int window_size);
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  std::string_view name() const { return name_; }
+  std::span<const Metric> metrics() const { return metrics_; }
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+  void set_enabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  // Times the enclosing scope and adds it to a metric, if profiler is not
+  // null and is enabled.
+  class Scope {
+   public:
+    Scope(Profiler* profiler, int metric)
+        : profiler_(profiler && profiler->enabled() ? profiler : nullptr),
+          metric_(metric) {
+      if (profiler_) start_ = Clock::now();
+    }
+    ~Scope() {
+      if (profiler_) profiler_->AddTime(metric_, start_, Clock::now());
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    Profiler* const profiler_;
+    const int metric_;
+    Clock::time_point start_;
+  };
+
+  // Adds to a metric for the current frame.
+  void Add(int metric, double value);
+  // Adds the time from start to end to a metric for the current frame, and
+  // records when it happened for traces. A metric may be timed several times
+  // in a frame, and each time is traced separately.
+  void AddTime(int metric, Clock::time_point start, Clock::time_point end);
+
+  // Finishes the current frame and starts the next one.
+  void EndFrame();
+
+  struct Summary {
+    double mean = 0, p50 = 0, p95 = 0, p99 = 0;
+  };
+  // Summarizes each metric over the recent frames.
+  std::vector<Summary> Summarize() const;
+
+  // Starts keeping every frame, discarding any earlier trace.
+  void StartTrace();
+  void StopTrace();
+
+  // Writes the trace as CSV, with a row per frame and a column per metric,
+  // with times in microseconds. Returns false if the file could not be
+  // written.
+  bool WriteCsv(const std::filesystem::path& path) const;
+
+  // Writes the traces from several profilers as a single file in the Chrome
+  // trace event format, which can be loaded by chrome://tracing or Perfetto.
+  // Each profiler appears as a separate thread. Returns false if the file
+  // could not be written.
+  static bool WriteChromeTrace(const std::filesystem::path& path,
+                               std::span<const Profiler* const> profilers);
+
+ private:
+  // A time recorded by AddTime().
+  struct Span {
+    int metric;
+    Clock::time_point start, end;
+  };
+
+  struct Frame {
+    Clock::time_point start;
+    // For each metric, its total.
+    std::vector<double> values;
+    // The times recorded with their start and end, in the order they ended.
+    std::vector<Span> spans;
+  };
+
+  const std::string_view name_;
+  const std::span<const Metric> metrics_;
+  const int window_size_;
+  std::atomic<bool> enabled_ = false;
+
+  // Owned by the recording thread.
+  Frame current_;
+
+  mutable std::mutex mutex_;
+  // Guarded by mutex_. The recent frames, as a ring buffer.
+  std::vector<Frame> window_;
+  int next_ = 0;
+  bool tracing_ = false;
+  std::vector<Frame> trace_;
+};
@@ -0,0 +1,210 @@
+#include "simulation.h"
+
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+// The log to record into, or the log to replay with the world options it
+// overrides filled in.
+InputLog InitialLog(const SimulationOptions& options) {
+  if (!options.replay) return InputLog{.options = options.world};
+  InputLog log = *options.replay;
+  log.options.threads = options.world.threads;
+  log.options.profiler = options.world.profiler;
+  return log;
+}
+
+void PrintFingerprint(const World& world) {
+  std::cerr << "Fingerprint: " << std::hex << std::setfill('0')
+            << std::setw(16) << world.Fingerprint() << std::dec
+            << std::setfill(' ') << '\n';
+}
+
+}  // namespace
+
+Simulation::Simulation(const SimulationOptions& options)
+    : record_(options.record),
+      replaying_(options.replay.has_value()),
+      log_(InitialLog(options)),
+      tick_(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1.0 / log_.options.tick_rate))),
+      world_(log_.options),
+      thread_([this] { Run(); }) {}
+
+Simulation::~Simulation() {
+  stopping_.store(true, std::memory_order_relaxed);
+  thread_.join();
+}
+
+void Simulation::Send(const Edit& edit) { Queue(edit); }
+
+void Simulation::Save(const std::filesystem::path& path) {
+  Queue(SaveRequest{.path = path});
+}
+
+void Simulation::Load(const std::filesystem::path& path) {
+  Queue(LoadRequest{.path = path});
+}
+
+void Simulation::Queue(const Request& request) {
+  pending_.push_back(request);
+  Latest();
+}
+
+const Simulation::Snapshot& Simulation::Latest() {
+  int sent = 0;
+  const int n = pending_.size();
+  while (sent < n && requests_.Push(pending_[sent])) sent++;
+  pending_.erase(pending_.begin(), pending_.begin() + sent);
+
+  snapshots_.Update();
+  return snapshots_.front();
+}
+
+void Simulation::Run() {
+  // The simulation falls behind if ticks take longer than tick_. Rather than
+  // trying to catch up indefinitely, it skips ticks if it falls too far behind.
+  // Replays instead run every tick as soon as the last one is done, and stop
+  // when the log ends.
+  constexpr int kMaxLag = 6;
+  std::optional<Replay> replay;
+  if (replaying_) replay.emplace(log_);
+  bool replayed = false;
+  std::uint64_t tick = 0;
+  const Clock::time_point start = Clock::now();
+  Clock::time_point next = start;
+  while (!stopping_.load(std::memory_order_relaxed)) {
+    const Clock::time_point now = Clock::now();
+    if (replay) {
+      if (replay->tick() == log_.ticks) {
+        if (!replayed) {
+          const double seconds =
+              std::chrono::duration<double>(now - start).count();
+          std::cerr << "Replayed " << tick << " ticks in " << seconds
+                    << " s (" << tick / seconds << " ticks/s).\n";
+          PrintFingerprint(world_);
+          replayed = true;
+        }
+        HandleRequests(tick);
+        std::this_thread::sleep_for(tick_);
+        continue;
+      }
+      next = now;
+    } else {
+      if (now < next) {
+        std::this_thread::sleep_until(next);
+        continue;
+      }
+      if (const auto missed = (now - next) / tick_ - kMaxLag; missed > 0) {
+        std::cerr << "Lag: missed " << missed
+                  << (missed == 1 ? " tick.\n" : " ticks.\n");
+        next += missed * tick_;
+      }
+    }
+
+    HandleRequests(tick);
+    if (replay) replay->Apply(world_);
+    world_.Update();
+    Publish(++tick, next);
+    next += tick_;
+  }
+
+  if (!record_.empty()) {
+    log_.ticks = tick;
+    if (!log_.Write(record_)) {
+      std::cerr << "Failed to write " << record_ << ".\n";
+      return;
+    }
+    std::cerr << "Recorded " << tick << " ticks to " << record_ << ".\n";
+    PrintFingerprint(world_);
+  }
+}
+
+void Simulation::HandleRequests(std::uint64_t tick) {
+  while (std::optional<Request> request = requests_.Pop()) {
+    if (const Edit* edit = std::get_if<Edit>(&*request)) {
+      // Edits would make a replay diverge from the log, so they are ignored.
+      if (replaying_) continue;
+      ApplyEdit(world_, *edit);
+      if (!record_.empty()) {
+        log_.events.push_back(InputLog::Event{.tick = tick, .edit = *edit});
+      }
+    } else if (const auto* save = std::get_if<SaveRequest>(&*request)) {
+      if (world_.Save(save->path)) {
+        std::cerr << "Saved " << save->path << ".\n";
+      } else {
+        std::cerr << "Failed to save " << save->path << ".\n";
+      }
+    } else {
+      const auto& load = std::get<LoadRequest>(*request);
+      if (replaying_ || !record_.empty()) {
+        std::cerr << "Cannot load a scene while recording or replaying.\n";
+      } else if (world_.Load(load.path)) {
+        std::cerr << "Loaded " << load.path << ".\n";
+      } else {
+        std::cerr << "Failed to load " << load.path << ".\n";
+      }
+    }
+  }
+}
+
+void Simulation::Publish(std::uint64_t tick, Clock::time_point time) {
+  Snapshot& snapshot = snapshots_.back();
+  snapshot.tick = tick;
+  snapshot.time = time;
+
+  // Sort the awake balls by tile, so that the ones in view can be drawn
+  // without looking at the rest.
+  const BallStore& balls = world_.balls();
+  positions_.clear();
+  for (int i = 0, n = balls.size(); i < n; i++) {
+    positions_.push_back(balls.position(i));
+  }
+  snapshot.ball_tiles.Build(positions_);
+  const std::span<const int> order = snapshot.ball_tiles.order();
+  const int n = order.size();
+  snapshot.previous.resize(n);
+  snapshot.current.resize(n);
+  for (int i = 0; i < n; i++) {
+    snapshot.previous[i] = balls.previous_position(order[i]);
+    snapshot.current[i] = positions_[order[i]];
+  }
+
+  // The sleeping balls are sorted in the same way, but only when they change,
+  // so that a settled world costs nothing here for the balls which sleep.
+  if (!sleeping_ || world_.sleeping_version() != sleeping_version_) {
+    const BallStore& sleeping = world_.sleeping_balls();
+    auto sleeping_balls = std::make_shared<SleepingBalls>();
+    positions_.clear();
+    for (int i = 0, num_sleeping = sleeping.size(); i < num_sleeping; i++) {
+      positions_.push_back(sleeping.position(i));
+    }
+    sleeping_balls->tiles.Build(positions_);
+    for (const int i : sleeping_balls->tiles.order()) {
+      sleeping_balls->positions.push_back(positions_[i]);
+    }
+    sleeping_ = std::move(sleeping_balls);
+    sleeping_version_ = world_.sleeping_version();
+  }
+  snapshot.sleeping = sleeping_;
+
+  // Lines change rarely, so they are only copied when they do and the copy
+  // is shared between snapshots.
+  if (!lines_ || world_.lines_version() != lines_version_ ||
+      world_.lines().size() != lines_->size()) {
+    lines_ = std::make_shared<const std::vector<Line>>(world_.lines().begin(),
+                                                       world_.lines().end());
+    auto line_tiles = std::make_shared<LineIndex>(kLineTileSize, 0.0f);
+    for (int i = 0, num_lines = lines_->size(); i < num_lines; i++) {
+      line_tiles->Add(i, (*lines_)[i]);
+    }
+    line_tiles_ = std::move(line_tiles);
+    lines_version_ = world_.lines_version();
+  }
+  snapshot.lines = lines_;
+  snapshot.line_tiles = line_tiles_;
+  snapshot.lines_version = lines_version_;
+
+  snapshots_.Publish();
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "input_log.h"
+#include "line_index.h"
+#include "spsc_queue.h"
+#include "tile_grid.h"
+#include "triple_buffer.h"
+#include "world.h"
+
+struct SimulationOptions {
+  WorldOptions world;
+  // If set, the edits are recorded, and written to this file as an input log
+  // when the simulation stops.
+  std::filesystem::path record;
+  // If set, the edits come from this input log rather than from Send(), and
+  // the ticks run as fast as possible until the log ends. The world options
+  // also come from the log, apart from the threads and the profiler.
+  std::optional<InputLog> replay;
+};
+
+// Runs a World on its own thread at a fixed rate of one tick per tick().
+// Edits are sent to it through a lock-free queue, and after every tick it
+// publishes a snapshot of the world through a lock-free triple buffer, so the
+// thread which draws the world never waits for the simulation or vice versa.
+// The outcome of saving and loading scenes, and of recording and replaying
+// input logs, is reported on stderr.
+class Simulation {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // The sizes of the tiles which snapshots use to find the balls and lines in
+  // view, and the most tiles the balls are split into.
+  static constexpr float kBallTileSize = 4 * kRadius;
+  static constexpr int kMaxBallTiles = 1 << 16;
+  static constexpr float kLineTileSize = 16;
+
+  // The position of each sleeping ball, sorted by the tile which contains it.
+  struct SleepingBalls {
+    std::vector<glm::vec2> positions;
+    TileGrid tiles{kBallTileSize, kMaxBallTiles};
+  };
+
+  struct Snapshot {
+    // The tick which produced this snapshot, and the time it was due.
+    std::uint64_t tick = 0;
+    Clock::time_point time;
+    // The position of each awake ball before and after the tick, sorted by the
+    // tile which contains its position after the tick.
+    std::vector<glm::vec2> previous, current;
+    TileGrid ball_tiles{kBallTileSize, kMaxBallTiles};
+    // The sleeping balls, which do not move. They are only rebuilt when balls
+    // fall asleep or wake.
+    std::shared_ptr<const SleepingBalls> sleeping =
+        std::make_shared<SleepingBalls>();
+    // The lines, and an index of the tiles they pass through, which are only
+    // rebuilt when they change.
+    std::shared_ptr<const std::vector<Line>> lines =
+        std::make_shared<std::vector<Line>>();
+    std::shared_ptr<const LineIndex> line_tiles =
+        std::make_shared<LineIndex>(kLineTileSize, 0.0f);
+    std::uint64_t lines_version = 0;
+  };
+
+  explicit Simulation(const SimulationOptions& options);
+  ~Simulation();
+
+  Simulation(const Simulation&) = delete;
+  Simulation& operator=(const Simulation&) = delete;
+
+  // The real time between ticks, which is the simulated time each tick
+  // covers.
+  Clock::duration tick() const { return tick_; }
+
+  // The remaining functions must all be called from the same thread.
+
+  // Queues an edit to be applied before the next tick.
+  void Send(const Edit& edit);
+  // Saves the world to a scene file after the current tick.
+  void Save(const std::filesystem::path& path);
+  // Replaces the world with one from a scene file before the next tick. This
+  // is refused while recording or replaying, since the input log could not
+  // reproduce it.
+  void Load(const std::filesystem::path& path);
+
+  // Returns the most recent snapshot. It remains valid until the next call.
+  // This also retries sending any edits which did not fit in the queue.
+  const Snapshot& Latest();
+
+ private:
+  struct SaveRequest {
+    std::filesystem::path path;
+  };
+  struct LoadRequest {
+    std::filesystem::path path;
+  };
+  using Request = std::variant<Edit, SaveRequest, LoadRequest>;
+
+  void Queue(const Request& request);
+  void Run();
+  // Handles the requests which have arrived, before the given tick.
+  void HandleRequests(std::uint64_t tick);
+  void Publish(std::uint64_t tick, Clock::time_point time);
+
+  const std::filesystem::path record_;
+  const bool replaying_;
+  // The edits being recorded or replayed, owned by the simulation thread.
+  InputLog log_;
+  const Clock::duration tick_;
+  World world_;
+  SpscQueue<Request, 4096> requests_;
+  TripleBuffer<Snapshot> snapshots_;
+  std::atomic<bool> stopping_ = false;
+
+  // Owned by the simulation thread.
+  std::shared_ptr<const std::vector<Line>> lines_;
+  std::shared_ptr<const LineIndex> line_tiles_;
+  std::uint64_t lines_version_ = 0;
+  std::shared_ptr<const SleepingBalls> sleeping_;
+  std::uint64_t sleeping_version_ = 0;
+  // Scratch space for sorting the balls by tile.
+  std::vector<glm::vec2> positions_;
+
+  // Owned by the sending thread: requests which did not fit in the queue.
+  std::vector<Request> pending_;
+
+  std::thread thread_;
+};
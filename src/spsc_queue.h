@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+
+// A fixed capacity lock-free queue with a single producer thread and a single
+// consumer thread.
+template <typename T, std::size_t kCapacity>
+class SpscQueue {
+ public:
+  static_assert((kCapacity & (kCapacity - 1)) == 0,
+                "kCapacity must be a power of two");
+
+  // Called by the producer. Returns false if the queue is full.
+  bool Push(const T& value) {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == kCapacity) {
+      return false;
+    }
+    items_[tail % kCapacity] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Called by the consumer. Returns nothing if the queue is empty.
+  std::optional<T> Pop() {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) return std::nullopt;
+    std::optional<T> value = std::move(items_[head % kCapacity]);
+    head_.store(head + 1, std::memory_order_release);
+    return value;
+  }
+
+ private:
+  std::array<T, kCapacity> items_;
+  alignas(64) std::atomic<std::size_t> head_ = 0;
+  alignas(64) std::atomic<std::size_t> tail_ = 0;
+};
@@ -0,0 +1,55 @@
+#include "stream_buffer.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr GLbitfield kMapFlags =
+    GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+void Wait(GLsync& fence) {
+  if (!fence) return;
+  while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000) ==
+         GL_TIMEOUT_EXPIRED) {
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+}  // namespace
+
+StreamBuffer::~StreamBuffer() {
+  for (GLsync fence : fences_) {
+    if (fence) glDeleteSync(fence);
+  }
+  if (buffer_) glDeleteBuffers(1, &buffer_);
+}
+
+void* StreamBuffer::MapBytes(std::size_t size) {
+  region_ = (region_ + 1) % kNumRegions;
+  if (size > region_size_) {
+    // Replace the buffer with a larger one. The GL keeps the old one alive
+    // until the GPU has finished with it.
+    for (GLsync& fence : fences_) {
+      if (fence) glDeleteSync(fence);
+      fence = nullptr;
+    }
+    if (buffer_) glDeleteBuffers(1, &buffer_);
+    constexpr std::size_t kAlignment = 256;
+    region_size_ = std::max(2 * region_size_, size);
+    region_size_ = (region_size_ + kAlignment - 1) / kAlignment * kAlignment;
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    glBufferStorage(GL_ARRAY_BUFFER, kNumRegions * region_size_, nullptr,
+                    kMapFlags);
+    data_ = static_cast<std::byte*>(glMapBufferRange(
+        GL_ARRAY_BUFFER, 0, kNumRegions * region_size_, kMapFlags));
+  }
+  Wait(fences_[region_]);
+  return data_ + offset();
+}
+
+void StreamBuffer::Fence() {
+  if (fences_[region_]) glDeleteSync(fences_[region_]);
+  fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <array>
+#include <cstddef>
+
+// A buffer for data which is rewritten every frame. It is persistently mapped
+// and split into regions which are used in rotation, so that the CPU can write
+// the data for one frame while the GPU is still reading the previous ones. A
+// fence guards each region so that it is never overwritten while in use.
+class StreamBuffer {
+ public:
+  StreamBuffer() = default;
+  ~StreamBuffer();
+
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+  // Returns space for count elements in the next region, waiting for the GPU
+  // to finish with it if necessary.
+  template <typename T>
+  T* Map(std::size_t count) {
+    return static_cast<T*>(MapBytes(count * sizeof(T)));
+  }
+
+  // Marks the end of the GPU commands which read the current region.
+  void Fence();
+
+  GLuint buffer() const { return buffer_; }
+  // The offset of the current region within the buffer.
+  GLintptr offset() const { return region_ * region_size_; }
+
+ private:
+  static constexpr int kNumRegions = 3;
+
+  void* MapBytes(std::size_t size);
+
+  GLuint buffer_ = 0;
+  std::byte* data_ = nullptr;
+  std::size_t region_size_ = 0;
+  int region_ = 0;
+  std::array<GLsync, kNumRegions> fences_ = {};
+};
@@ -0,0 +1,62 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int threads) {
+  for (int i = 1; i < threads; i++) workers_.emplace_back([this] { Work(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  start_.notify_all();
+  for (std::thread& worker : workers_) worker.join();
+}
+
+void ThreadPool::ParallelFor(int n, const std::function<void(int)>& task) {
+  if (workers_.empty() || n <= 1) {
+    for (int i = 0; i < n; i++) task(i);
+    return;
+  }
+
+  {
+    std::lock_guard lock(mutex_);
+    task_ = &task;
+    num_tasks_ = n;
+    next_task_.store(0, std::memory_order_relaxed);
+    active_ = workers_.size();
+    generation_++;
+  }
+  start_.notify_all();
+  RunTasks();
+
+  std::unique_lock lock(mutex_);
+  done_.wait(lock, [&] { return active_ == 0; });
+  task_ = nullptr;
+}
+
+void ThreadPool::Work() {
+  std::uint64_t generation = 0;
+  while (true) {
+    {
+      std::unique_lock lock(mutex_);
+      start_.wait(lock,
+                  [&] { return stopping_ || generation_ != generation; });
+      if (stopping_) return;
+      generation = generation_;
+    }
+    RunTasks();
+    {
+      std::lock_guard lock(mutex_);
+      if (--active_ == 0) done_.notify_one();
+    }
+  }
+}
+
+void ThreadPool::RunTasks() {
+  while (true) {
+    const int i = next_task_.fetch_add(1, std::memory_order_relaxed);
+    if (i >= num_tasks_) return;
+    (*task_)(i);
+  }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads which cooperate with the calling thread to run
+// batches of independent tasks.
+class ThreadPool {
+ public:
+  // Creates a pool which runs tasks on `threads` threads in total, including
+  // the thread which calls ParallelFor().
+  explicit ThreadPool(int threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int size() const { return workers_.size() + 1; }
+
+  // Calls task(i) for every i in [0, n) and waits for all of them to finish.
+  // Tasks may run concurrently and in any order.
+  void ParallelFor(int n, const std::function<void(int)>& task);
+
+ private:
+  void Work();
+  void RunTasks();
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_, done_;
+
+  // Guarded by mutex_.
+  std::uint64_t generation_ = 0;
+  int active_ = 0;
+  bool stopping_ = false;
+
+  // Describes the current batch. Published to the workers by mutex_.
+  const std::function<void(int)>* task_ = nullptr;
+  int num_tasks_ = 0;
+  std::atomic<int> next_task_ = 0;
+};
@@ -0,0 +1,69 @@
+#include "tile_grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+void TileGrid::Build(std::span<const glm::vec2> points) {
+  const int n = points.size();
+  order_.resize(n);
+  if (n == 0) {
+    columns_ = rows_ = 0;
+    starts_.assign(1, 0);
+    return;
+  }
+
+  // Cover the bounding box with as few doublings of the tile size as keep the
+  // number of tiles within the limit.
+  glm::vec2 min = points[0], max = points[0];
+  for (const glm::vec2 p : points) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+  origin_ = min;
+  tile_size_ = min_tile_size_;
+  const glm::vec2 extent = max - min;
+  while ((std::floor(extent.x / tile_size_) + 1) *
+             (std::floor(extent.y / tile_size_) + 1) >
+         max_tiles_) {
+    tile_size_ *= 2;
+  }
+  columns_ = int(extent.x / tile_size_) + 1;
+  rows_ = int(extent.y / tile_size_) + 1;
+
+  // Counting sort the points by tile.
+  const float scale = 1 / tile_size_;
+  keys_.resize(n);
+  starts_.assign(columns_ * rows_ + 1, 0);
+  for (int i = 0; i < n; i++) {
+    const glm::vec2 offset = (points[i] - origin_) * scale;
+    const int x = std::min(int(offset.x), columns_ - 1);
+    const int y = std::min(int(offset.y), rows_ - 1);
+    keys_[i] = y * columns_ + x;
+    starts_[keys_[i] + 1]++;
+  }
+  for (int i = 0, num_tiles = columns_ * rows_; i < num_tiles; i++) {
+    starts_[i + 1] += starts_[i];
+  }
+  cursors_.assign(starts_.begin(), starts_.end() - 1);
+  for (int i = 0; i < n; i++) order_[cursors_[keys_[i]]++] = i;
+}
+
+TileGrid::Rect TileGrid::Cover(glm::vec2 min, glm::vec2 max) const {
+  // Clamp before converting, so that distant rectangles cannot overflow.
+  const auto tile = [&](float offset, int size) {
+    return int(std::clamp(std::floor(offset / tile_size_), 0.0f,
+                          float(size - 1)));
+  };
+  if (columns_ == 0 || min.x > max.x || min.y > max.y) {
+    return Rect{0, 0, -1, -1};
+  }
+  const glm::vec2 end = origin_ + glm::vec2(columns_, rows_) * tile_size_;
+  if (max.x < origin_.x || max.y < origin_.y || min.x >= end.x ||
+      min.y >= end.y) {
+    return Rect{0, 0, -1, -1};
+  }
+  return Rect{.x_min = tile(min.x - origin_.x, columns_),
+              .y_min = tile(min.y - origin_.y, rows_),
+              .x_max = tile(max.x - origin_.x, columns_),
+              .y_max = tile(max.y - origin_.y, rows_)};
+}
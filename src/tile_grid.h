@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <span>
+#include <vector>
+
+// A coarse grid of square tiles over the bounding box of a set of points,
+// stored in compressed sparse row form, for finding the points within a
+// rectangle. Unlike BallGrid, every tile in the bounding box has a slot, which
+// makes it cheap to build and to scan a rectangle at a time, but means it is
+// only suitable for tiles much larger than the points are apart. The tiles
+// are enlarged as needed to keep their number within a limit, however far
+// apart the points are.
+class TileGrid {
+ public:
+  TileGrid(float tile_size, int max_tiles)
+      : min_tile_size_(tile_size), max_tiles_(max_tiles) {}
+
+  // Sorts the points by tile. Tiles are in row-major order, and within each
+  // tile the points keep their relative order. Afterwards, the point at
+  // position j of the sorted order is points[order()[j]].
+  void Build(std::span<const glm::vec2> points);
+  std::span<const int> order() const { return order_; }
+
+  float tile_size() const { return tile_size_; }
+  int columns() const { return columns_; }
+  int rows() const { return rows_; }
+  // The corner of tile (x, y) with the smallest coordinates.
+  glm::vec2 tile_min(int x, int y) const {
+    return origin_ + glm::vec2(x, y) * tile_size_;
+  }
+  int count(int x, int y) const {
+    const int i = y * columns_ + x;
+    return starts_[i + 1] - starts_[i];
+  }
+
+  // The tiles which overlap the rectangle [min, max], clamped to the grid.
+  // It is empty if x_min > x_max or y_min > y_max.
+  struct Rect {
+    int x_min, y_min, x_max, y_max;
+  };
+  Rect Cover(glm::vec2 min, glm::vec2 max) const;
+
+  struct Range {
+    int begin, end;
+  };
+  // Returns the positions in the sorted order of the points in tiles x_min to
+  // x_max of row y, which are contiguous.
+  Range FindRow(int y, int x_min, int x_max) const {
+    return Range{starts_[y * columns_ + x_min],
+                 starts_[y * columns_ + x_max + 1]};
+  }
+
+ private:
+  const float min_tile_size_;
+  const int max_tiles_;
+
+  float tile_size_ = 0;
+  glm::vec2 origin_ = glm::vec2();
+  int columns_ = 0, rows_ = 0;
+  // For each tile, the position of its first point, plus the total at the end.
+  std::vector<int> starts_ = {0};
+  std::vector<int> order_;
+
+  // Scratch space for Build().
+  std::vector<int> keys_, cursors_;
+};
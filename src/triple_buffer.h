@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// A lock-free handoff of values from a single writer thread to a single reader
+// thread. The writer always has a slot to fill and the reader always has the
+// most recent complete value, and neither ever waits for the other.
+template <typename T>
+class TripleBuffer {
+ public:
+  // Called by the writer: the slot to fill in before calling Publish().
+  T& back() { return slots_[back_]; }
+
+  // Called by the writer: makes the back slot available to the reader.
+  void Publish() {
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) &
+            kIndex;
+  }
+
+  // Called by the reader: moves to the most recently published value, if
+  // there is a new one. Returns true if it did.
+  bool Update() {
+    if (!(middle_.load(std::memory_order_relaxed) & kFresh)) return false;
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndex;
+    return true;
+  }
+
+  // Called by the reader: the most recent value as of the last Update().
+  const T& front() const { return slots_[front_]; }
+
+ private:
+  static constexpr int kIndex = 3;
+  static constexpr int kFresh = 4;
+
+  std::array<T, 3> slots_;
+  int back_ = 0;
+  int front_ = 1;
+  std::atomic<int> middle_ = 2;
+};
@@ -0,0 +1,1205 @@
+#include "world.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+#include "kernels.h"
+#include "mapped_file.h"
+
+namespace {
+
+constexpr float kCellSize = 2 * kRadius;
+
+// The number of cells or balls handed to a thread at a time.
+constexpr int kChunkSize = 64;
+// The number of balls tested against a ball at a time.
+constexpr int kBatchSize = 64;
+
+float Cross(glm::vec2 a, glm::vec2 b) { return a.x * b.y - a.y * b.x; }
+
+// Where a ball touches a line.
+enum class Touch { kNone, kEnd, kInterior };
+
+// Returns where a ball at position touches the line, and sets closest to the
+// closest point on the line. At the ends, closest is exactly the end point.
+Touch FindTouch(glm::vec2 position, const Line& line, glm::vec2& closest) {
+  const glm::vec2 d = line.b - line.a;
+  const glm::vec2 v = position - line.a;
+  const float t = glm::dot(d, v) / glm::dot(d, d);
+  // A line of zero length gives a t of NaN, and is treated as its end.
+  const bool interior = t > 0 && t < 1;
+  closest = interior ? line.a + t * d : t >= 1 ? line.b : line.a;
+  const glm::vec2 offset = position - closest;
+  if (glm::dot(offset, offset) > kRadius * kRadius) return Touch::kNone;
+  return interior ? Touch::kInterior : Touch::kEnd;
+}
+
+// Pushes a ball out of contact with the closest point on a line it touches,
+// along the given unit normal. The ball's center may be behind the line.
+void CollideBallLine(Ball& ball, glm::vec2 closest, glm::vec2 normal) {
+  const float overlap = kRadius - glm::dot(ball.position - closest, normal);
+  ball.position += 0.8f * overlap * normal;
+  const float separation_speed = glm::dot(ball.velocity, normal);
+  if (separation_speed < 0) {
+    ball.velocity -= 1.8f * separation_speed * normal;
+  }
+}
+
+// Returns true if the balls collided.
+bool CollideBalls(Ball& a, Ball& b) {
+  // Check for a collision.
+  const glm::vec2 offset = b.position - a.position;
+  const float square_distance = glm::dot(offset, offset);
+  if (square_distance > 4 * kRadius * kRadius) return false;
+
+  // Handle the collision.
+  // Balls at the same position are pushed apart along an arbitrary axis.
+  const float overlap = 2 * kRadius - std::sqrt(square_distance);
+  const glm::vec2 normal = square_distance > 0 ? glm::normalize(offset)
+                                               : glm::vec2(1, 0);
+  a.position -= 0.4f * overlap * normal;
+  b.position += 0.4f * overlap * normal;
+  const float separation_speed = glm::dot(b.velocity - a.velocity, normal);
+  if (separation_speed < 0) {
+    const glm::vec2 correction = 0.9f * separation_speed * normal;
+    a.velocity += correction;
+    b.velocity -= correction;
+  }
+  return true;
+}
+
+// A ball which moves further than this in one tick is swept along its path,
+// since the contact tests at the end of the tick could miss a line or ball
+// which it passed through on the way.
+constexpr float kFastDistance = kRadius;
+// Balls which end the tick within this of a fast ball's path are swept
+// against it.
+constexpr float kSweepMargin = 2.5f * kRadius;
+// The most times a fast ball bounces within one tick. A ball which would
+// bounce again stops where it last bounced until the next tick.
+constexpr int kMaxBounces = 4;
+
+// Returns true if the center of a ball moving from p by d crosses the line or
+// ends on it, and sets normal to the unit normal of the line on the side it
+// came from.
+bool CrossesLine(glm::vec2 p, glm::vec2 d, const Line& line,
+                 glm::vec2& normal) {
+  const glm::vec2 e = line.b - line.a;
+  const float side = Cross(e, p - line.a);
+  const float end_side = Cross(e, p + d - line.a);
+  if (side == 0 || (side > 0 ? end_side > 0 : end_side < 0)) return false;
+  const glm::vec2 crossing = p + side / (side - end_side) * d;
+  const float u = glm::dot(crossing - line.a, e) / glm::dot(e, e);
+  if (!(u >= 0 && u <= 1)) return false;
+  normal = glm::normalize(side > 0 ? glm::vec2(-e.y, e.x)
+                                   : glm::vec2(e.y, -e.x));
+  return true;
+}
+
+// If a point whose offset from another is m, and which moves by d relative to
+// it, comes within distance of it, returns the fraction of d after which it
+// does. Points which are already that close are left to the contact tests.
+std::optional<float> SweepPoints(glm::vec2 m, glm::vec2 d, float distance) {
+  const float a = glm::dot(d, d);
+  const float b = glm::dot(m, d);
+  const float c = glm::dot(m, m) - distance * distance;
+  if (c <= 0 || b >= 0) return std::nullopt;
+  const float discriminant = b * b - a * c;
+  if (discriminant < 0) return std::nullopt;
+  const float t = (-b - std::sqrt(discriminant)) / a;
+  if (t > 1) return std::nullopt;
+  return t;
+}
+
+// If a ball moving from p by d runs into the line, returns the fraction of d
+// after which it first touches the line, and sets normal to the unit normal of
+// the line at that contact. The ball is swept as a capsule around its path, so
+// it touches a side of the line once its center comes within kRadius of it,
+// and an end once its center comes within kRadius of the end point. A ball
+// which already touches the line is left to the contact tests, unless its
+// center crosses it.
+std::optional<float> SweepBallLine(glm::vec2 p, glm::vec2 d, const Line& line,
+                                   glm::vec2& normal) {
+  if (CrossesLine(p, d, line, normal)) {
+    const float distance = glm::dot(p - line.a, normal);
+    return std::max(0.0f, (distance - kRadius) / -glm::dot(d, normal));
+  }
+
+  // The side of the line facing the ball, moved out by kRadius.
+  std::optional<float> hit;
+  const glm::vec2 e = line.b - line.a;
+  const float side = Cross(e, p - line.a);
+  if (side != 0) {
+    const glm::vec2 side_normal = glm::normalize(
+        side > 0 ? glm::vec2(-e.y, e.x) : glm::vec2(e.y, -e.x));
+    const float gap = glm::dot(p - line.a, side_normal) - kRadius;
+    const float approach = -glm::dot(d, side_normal);
+    if (gap > 0 && gap <= approach) {
+      const float t = gap / approach;
+      const float u = glm::dot(p + t * d - line.a, e) / glm::dot(e, e);
+      if (u >= 0 && u <= 1) {
+        hit = t;
+        normal = side_normal;
+      }
+    }
+  }
+
+  // The ends of the line. Where the ball meets a side at the same moment as an
+  // end, such as at a joint between lines, the side wins.
+  for (const glm::vec2 end : {line.a, line.b}) {
+    const std::optional<float> t = SweepPoints(p - end, d, kRadius);
+    if (t && (!hit || *t < *hit)) {
+      hit = t;
+      normal = glm::normalize(p - end + *t * d);
+    }
+  }
+  return hit;
+}
+
+// If a ball whose offset from another is m, and which moves by d relative to
+// it, comes into contact with it, returns the fraction of d after which it
+// does. Balls which already touch are left to the contact tests.
+std::optional<float> SweepBalls(glm::vec2 m, glm::vec2 d) {
+  return SweepPoints(m, d, 2 * kRadius);
+}
+
+// A ball is at rest once it has stayed within kRestDrift of where it came to
+// rest for kSleepSeconds. Balls in a pile never stop jittering, and wander by
+// up to about a radius while the pile as a whole stays put, so neither their
+// speed at any one instant nor a tighter drift says whether they have settled.
+constexpr float kRestDrift = kRadius;
+constexpr float kSleepSeconds = 0.5f;
+// An island sleeps once every one of its balls is at rest and moving slower
+// than kSleepSpeed. Islands are checked kSleepChecks times every kSleepSeconds.
+constexpr float kSleepSpeed = 8.0f;
+constexpr int kSleepChecks = 4;
+// Sleeping balls are woken by anything which comes within kSleepDrift of
+// touching them.
+constexpr float kSleepDrift = 0.1f * kRadius;
+// Balls closer than this are treated as touching when forming islands, so
+// that a ball which falls asleep up to kSleepDrift short of a contact joins
+// the island it would wake.
+constexpr float kIslandDistance = 2.2f * kRadius;
+
+// The lanes of an emitter are kLaneSpacing apart. An emitter has enough lanes
+// for its rate when each lane adds a ball on the first tick after the last one
+// has moved 2 * kRadius away, up to kMaxEmitterLanes.
+constexpr float kLaneSpacing = 2.05f * kRadius;
+
+// Contacts are soft at tick rates below kDefaultTickRate, since the balls
+// press further into each other in a longer tick. Packing a deep pile as
+// tightly as at the default rate takes a few more passes than there would be
+// ticks at that rate (6 at 60 Hz on the pile benchmark), which costs more than
+// running at that rate. The number of passes only grows with the square root
+// of the ratio instead, so a lower rate stays cheaper but deep piles are
+// crushed at the bottom below about 120 Hz.
+int ContactPasses(int tick_rate) {
+  return std::max(
+      1, int(std::ceil(std::sqrt(float(kDefaultTickRate) / tick_rate))));
+}
+
+// Returns true if a ball at p would touch any of the balls in the grid.
+bool Touches(glm::vec2 p, const BallStore& balls, const BallGrid& grid) {
+  const BallGrid::Cell cell = grid.CellAt(p);
+  for (int dy = -1; dy <= 1; dy++) {
+    const BallGrid::Range row =
+        grid.FindRow(cell.y + dy, cell.x - 1, cell.x + 1);
+    for (int j = row.begin; j < row.end; j++) {
+      if (glm::distance(p, balls.position(j)) < 2 * kRadius) return true;
+    }
+  }
+  return false;
+}
+
+// Returns the distance from p to the line.
+float Distance(glm::vec2 p, const Line& line) {
+  const glm::vec2 d = line.b - line.a;
+  const glm::vec2 v = p - line.a;
+  const float t = std::clamp(glm::dot(d, v) / glm::dot(d, d), 0.0f, 1.0f);
+  return glm::distance(p, line.a + t * d);
+}
+
+// Each contact pass of the Jacobi solver runs kJacobiIterations iterations,
+// and each applies kJacobiRelaxation of the summed corrections. Applying all
+// of them would make a ball pressed on from several sides overshoot, since
+// every contact assumes it is the only one. A single iteration at a higher
+// fraction throws balls out of piles which start at rest, so two iterations
+// at 0.75 were chosen instead, tuned on the pile and spread benchmarks.
+constexpr float kJacobiRelaxation = 0.75f;
+constexpr int kJacobiIterations = 2;
+
+// Adds a's half of the response to a contact with b to the corrections for a,
+// using the same response as CollideBalls(). first says whether a comes before
+// b, which picks opposite axes for the two if they are at the same position.
+// Returns true if they touch.
+bool AddContact(const Ball& a, const Ball& b, bool first,
+                glm::vec2& position_correction,
+                glm::vec2& velocity_correction) {
+  const glm::vec2 offset = b.position - a.position;
+  const float square_distance = glm::dot(offset, offset);
+  if (square_distance > 4 * kRadius * kRadius) return false;
+
+  const float overlap = 2 * kRadius - std::sqrt(square_distance);
+  const glm::vec2 normal = square_distance > 0 ? glm::normalize(offset)
+                           : first             ? glm::vec2(1, 0)
+                                               : glm::vec2(-1, 0);
+  position_correction -= 0.4f * overlap * normal;
+  const float separation_speed = glm::dot(b.velocity - a.velocity, normal);
+  if (separation_speed < 0) {
+    velocity_correction += 0.9f * separation_speed * normal;
+  }
+  return true;
+}
+
+// A scene file starts with a SceneHeader, followed by the sections whose
+// offsets it gives. Each section, and each array within the ball sections,
+// starts on a multiple of kSceneAlignment bytes, so that a mapped file can be
+// copied straight into place or used as it is. Values are stored in the byte
+// order of the machine which wrote the file.
+constexpr char kSceneMagic[8] = "BALLSCN";
+constexpr std::uint32_t kSceneVersion = 3;
+constexpr std::uint32_t kByteOrderMark = 0x01020304;
+constexpr std::uint64_t kSceneAlignment = 64;
+
+struct SceneHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  // The awake balls and the sleeping balls. Each section is made up of
+  // BallStore::kNumComponents arrays of floats followed by an array of tags.
+  std::uint64_t balls_offset, sleeping_offset;
+  std::uint32_t num_balls, num_sleeping;
+  // The lines, and the lines which have changed since the last tick.
+  std::uint64_t lines_offset, changed_lines_offset;
+  std::uint32_t num_lines, num_changed_lines;
+  // The emitters, with the balls each owes.
+  std::uint64_t emitters_offset;
+  std::uint32_t num_emitters;
+  // The ticks until the islands are next checked for sleep.
+  std::int32_t sleep_countdown;
+  // The state of the random number generator, as text.
+  std::uint64_t generator_offset;
+  std::uint32_t generator_size;
+  std::int32_t next_island;
+};
+static_assert(std::is_trivially_copyable_v<SceneHeader>);
+static_assert(std::is_trivially_copyable_v<Line>);
+static_assert(sizeof(float) == 4 && sizeof(int) == 4);
+
+std::uint64_t AlignScene(std::uint64_t offset) {
+  return (offset + kSceneAlignment - 1) / kSceneAlignment * kSceneAlignment;
+}
+
+// The size of each array in a section of n balls.
+std::uint64_t BallArraySize(std::uint64_t n) { return AlignScene(4 * n); }
+
+// The size of a section of n balls.
+std::uint64_t BallSectionSize(std::uint64_t n) {
+  return (BallStore::kNumComponents + 1) * BallArraySize(n);
+}
+
+// Calls f(data, size) for each array of a ball section, in order. Store is
+// either BallStore or const BallStore.
+template <typename Store, typename F>
+void ForEachBallArray(Store& balls, F f) {
+  for (int k = 0; k < BallStore::kNumComponents; k++) {
+    f(balls.component(k).data(), 4 * balls.size());
+  }
+  f(balls.tags().data(), 4 * balls.size());
+}
+
+std::string GeneratorState(const std::ranlux24& gen) {
+  std::ostringstream state;
+  state << gen;
+  return state.str();
+}
+
+// 64-bit FNV-1a.
+std::uint64_t Hash(std::uint64_t hash, const void* data, std::size_t size) {
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3;
+  }
+  return hash;
+}
+
+}  // namespace
+
+World::World(const WorldOptions& options)
+    : gen_(options.seed),
+      pool_(options.threads),
+      tick_rate_(options.tick_rate),
+      delta_time_(1.0f / options.tick_rate),
+      contact_passes_(ContactPasses(options.tick_rate)),
+      kill_radius_(options.kill_radius),
+      solver_(options.solver),
+      sleep_(options.sleep),
+      profiler_(options.profiler),
+      grid_(kCellSize),
+      line_index_(kCellSize, kRadius),
+      sleeping_grid_(kCellSize) {}
+
+void World::AddLine(const Line& line) {
+  line_index_.Add(lines_.size(), line);
+  lines_.push_back(line);
+  if (!sleeping_.empty()) changed_lines_.push_back(line);
+}
+
+void World::RemoveLine(int i) {
+  const int last = lines_.size() - 1;
+  if (!sleeping_.empty()) changed_lines_.push_back(lines_[i]);
+  line_index_.Remove(i, lines_[i]);
+  if (i != last) {
+    line_index_.Rename(last, i, lines_[last]);
+    lines_[i] = lines_[last];
+  }
+  lines_.pop_back();
+  lines_version_++;
+}
+
+bool World::AddBall(const Ball& ball) {
+  // Once balls have been taken out of the grid, as when an island falls asleep
+  // or a scene is loaded, it is rebuilt rather than checking the ball against
+  // every awake one. The balls added after it are checked one by one.
+  if (gridded_ == 0 && !balls_.empty()) SortBalls();
+  if (!IsClear(ball.position)) return false;
+  balls_.push_back(ball);
+  return true;
+}
+
+int World::AddBalls(std::span<const Ball> balls) {
+  balls_.reserve(balls_.size() + balls.size());
+  int added = 0;
+  for (const Ball& ball : balls) added += AddBall(ball);
+  return added;
+}
+
+bool World::IsClear(glm::vec2 p) const {
+  // The grids are still valid between ticks, since the balls have moved only
+  // slightly since they were built. The balls added since come after those in
+  // the grid.
+  if (gridded_ > 0 && Touches(p, balls_, grid_)) return false;
+  if (Touches(p, sleeping_, sleeping_grid_)) return false;
+  for (int j = gridded_, n = balls_.size(); j < n; j++) {
+    if (glm::distance(p, balls_.position(j)) < 2 * kRadius) return false;
+  }
+  return true;
+}
+
+void World::AddEmitter(const Emitter& emitter) {
+  emitters_.push_back(EmitterState{.emitter = emitter});
+}
+
+bool World::Save(const std::filesystem::path& path) const {
+  static_assert(std::is_trivially_copyable_v<EmitterState>);
+  const std::string generator = GeneratorState(gen_);
+  SceneHeader header = {};
+  std::memcpy(header.magic, kSceneMagic, sizeof(header.magic));
+  header.version = kSceneVersion;
+  header.byte_order = kByteOrderMark;
+  header.num_balls = balls_.size();
+  header.num_sleeping = sleeping_.size();
+  header.num_lines = lines_.size();
+  header.num_changed_lines = changed_lines_.size();
+  header.num_emitters = emitters_.size();
+  header.generator_size = generator.size();
+  header.next_island = next_island_;
+  header.sleep_countdown = sleep_countdown_;
+  header.balls_offset = AlignScene(sizeof(header));
+  header.sleeping_offset =
+      header.balls_offset + BallSectionSize(header.num_balls);
+  header.lines_offset =
+      header.sleeping_offset + BallSectionSize(header.num_sleeping);
+  header.changed_lines_offset =
+      AlignScene(header.lines_offset + sizeof(Line) * header.num_lines);
+  header.emitters_offset = AlignScene(header.changed_lines_offset +
+                                      sizeof(Line) * header.num_changed_lines);
+  header.generator_offset = AlignScene(
+      header.emitters_offset + sizeof(EmitterState) * header.num_emitters);
+
+  std::ofstream file(path, std::ios::binary);
+  std::uint64_t position = 0;
+  const auto write = [&](const void* data, std::uint64_t size) {
+    file.write(static_cast<const char*>(data), size);
+    position += size;
+  };
+  const auto pad = [&] {
+    static constexpr char kZeros[kSceneAlignment] = {};
+    write(kZeros, AlignScene(position) - position);
+  };
+  write(&header, sizeof(header));
+  for (const BallStore* balls : {&balls_, &sleeping_}) {
+    ForEachBallArray(*balls, [&](const void* data, std::uint64_t size) {
+      pad();
+      write(data, size);
+    });
+    pad();
+  }
+  write(lines_.data(), sizeof(Line) * lines_.size());
+  pad();
+  write(changed_lines_.data(), sizeof(Line) * changed_lines_.size());
+  pad();
+  write(emitters_.data(), sizeof(EmitterState) * emitters_.size());
+  pad();
+  write(generator.data(), generator.size());
+  return file.good();
+}
+
+bool World::Load(const std::filesystem::path& path) {
+  MappedFile file;
+  if (!file.Open(path)) return false;
+  const std::span<const std::byte> bytes = file.bytes();
+
+  // Check that the file is complete and compatible before changing anything.
+  SceneHeader header;
+  if (bytes.size() < sizeof(header)) return false;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  const auto fits = [&](std::uint64_t offset, std::uint64_t size) {
+    return offset <= bytes.size() && size <= bytes.size() - offset;
+  };
+  if (std::memcmp(header.magic, kSceneMagic, sizeof(header.magic)) != 0 ||
+      header.version != kSceneVersion ||
+      header.byte_order != kByteOrderMark ||
+      !fits(header.balls_offset, BallSectionSize(header.num_balls)) ||
+      !fits(header.sleeping_offset, BallSectionSize(header.num_sleeping)) ||
+      !fits(header.lines_offset, sizeof(Line) * header.num_lines) ||
+      !fits(header.changed_lines_offset,
+            sizeof(Line) * header.num_changed_lines) ||
+      !fits(header.emitters_offset,
+            sizeof(EmitterState) * header.num_emitters) ||
+      !fits(header.generator_offset, header.generator_size) ||
+      header.num_balls > INT32_MAX || header.num_sleeping > INT32_MAX ||
+      header.num_lines > INT32_MAX || header.num_emitters > INT32_MAX) {
+    return false;
+  }
+  std::ranlux24 gen;
+  std::istringstream generator(std::string(
+      reinterpret_cast<const char*>(bytes.data() + header.generator_offset),
+      header.generator_size));
+  if (!(generator >> gen)) return false;
+
+  // Copy the balls and lines into place.
+  const auto load_balls = [&](BallStore& balls, std::uint64_t offset,
+                              std::uint32_t n) {
+    balls.resize(n);
+    ForEachBallArray(balls, [&](void* data, std::uint64_t size) {
+      std::memcpy(data, bytes.data() + offset, size);
+      offset += BallArraySize(n);
+    });
+  };
+  load_balls(balls_, header.balls_offset, header.num_balls);
+  load_balls(sleeping_, header.sleeping_offset, header.num_sleeping);
+  const auto* const lines =
+      reinterpret_cast<const Line*>(bytes.data() + header.lines_offset);
+  lines_.assign(lines, lines + header.num_lines);
+  const auto* const changed_lines = reinterpret_cast<const Line*>(
+      bytes.data() + header.changed_lines_offset);
+  changed_lines_.assign(changed_lines,
+                        changed_lines + header.num_changed_lines);
+  const auto* const emitters = reinterpret_cast<const EmitterState*>(
+      bytes.data() + header.emitters_offset);
+  emitters_.assign(emitters, emitters + header.num_emitters);
+  next_island_ = header.next_island;
+  sleep_countdown_ = header.sleep_countdown;
+  gen_ = gen;
+
+  // Rebuild everything which is derived from the state.
+  line_index_.Clear();
+  for (int i = 0, n = lines_.size(); i < n; i++) line_index_.Add(i, lines_[i]);
+  lines_version_++;
+  gridded_ = 0;
+  SortSleepingBalls();
+  return true;
+}
+
+std::uint64_t World::Fingerprint() const {
+  std::uint64_t hash = 0xcbf29ce484222325;
+  for (const BallStore* balls : {&balls_, &sleeping_}) {
+    ForEachBallArray(*balls, [&](const void* data, std::uint64_t size) {
+      hash = Hash(hash, data, size);
+    });
+  }
+  hash = Hash(hash, lines_.data(), sizeof(Line) * lines_.size());
+  hash = Hash(hash, changed_lines_.data(),
+              sizeof(Line) * changed_lines_.size());
+  hash = Hash(hash, emitters_.data(), sizeof(EmitterState) * emitters_.size());
+  hash = Hash(hash, &next_island_, sizeof(next_island_));
+  hash = Hash(hash, &sleep_countdown_, sizeof(sleep_countdown_));
+  const std::string generator = GeneratorState(gen_);
+  return Hash(hash, generator.data(), generator.size());
+}
+
+void World::Update() {
+  counting_ = profiler_ && profiler_->enabled();
+
+  // Update the balls according to gravity.
+  {
+    Profiler::Scope scope(profiler_, kIntegrateTime);
+    balls_.SavePositions();
+    IntegrateBalls(balls_.x(), balls_.y(), balls_.vx(), balls_.vy(),
+                   balls_.size(), kGravity * delta_time_, delta_time_);
+  }
+
+  // Remove balls which have moved far away from the origin.
+  if (kill_radius_) {
+    Profiler::Scope scope(profiler_, kKillTime);
+    const float square_radius = *kill_radius_ * *kill_radius_;
+    for (int i = 0; (i = FindBallOutside(balls_.x(), balls_.y(), i,
+                                         balls_.size(), square_radius)) <
+                    balls_.size();) {
+      balls_.Remove(i);
+    }
+  }
+
+  // Sort the balls into grid cells. For the sequential solver, the balls are
+  // shuffled within each cell to prevent their order from mattering. The
+  // Jacobi solver does not depend on the order, so the balls keep the order
+  // from the previous tick and stay sorted for locality.
+  SortBalls();
+
+  // Balls which moved far enough to pass through something are moved back to
+  // where they first hit it. The grid only needs rebuilding if any were.
+  {
+    bool swept;
+    {
+      Profiler::Scope scope(profiler_, kSweepTime);
+      swept = SweepFastBalls();
+    }
+    if (swept) SortBalls();
+  }
+
+  // Wake any islands which have been touched, and add their balls to the grid.
+  if (!sleeping_.empty()) {
+    bool woken;
+    {
+      Profiler::Scope scope(profiler_, kWakeTime);
+      woken = WakeIslands();
+    }
+    if (woken) SortBalls();
+  }
+
+  // At lower tick rates, the contacts are resolved over several passes. The
+  // balls move only slightly in each, so the grid stays valid throughout.
+  for (int pass = 0; pass < contact_passes_; pass++) {
+    {
+      Profiler::Scope scope(profiler_, kLineContactTime);
+      CollideLines();
+    }
+    Profiler::Scope scope(profiler_, kBallContactTime);
+    switch (solver_) {
+      case Solver::kSequential:
+        SolveSequential();
+        break;
+      case Solver::kJacobi:
+        SolveJacobi();
+        break;
+    }
+  }
+
+  // The ball contacts can push a ball in a crowd through a line, so this makes
+  // sure that none end the tick on the wrong side of one.
+  {
+    Profiler::Scope scope(profiler_, kUncrossTime);
+    UncrossLines();
+  }
+
+  if (!emitters_.empty()) {
+    Profiler::Scope scope(profiler_, kEmitTime);
+    Emit();
+  }
+
+  if (sleep_) {
+    Profiler::Scope scope(profiler_, kSleepTime);
+    UpdateSleep();
+  }
+
+  if (counting_) {
+    profiler_->Add(kCandidatePairs, candidate_pairs_.exchange(0));
+    profiler_->Add(kContacts, contacts_.exchange(0));
+    profiler_->Add(kAwakeBalls, balls_.size());
+    profiler_->Add(kFastBalls, fast_.size());
+  }
+  if (profiler_) profiler_->EndFrame();
+}
+
+void World::SortBalls() {
+  {
+    Profiler::Scope scope(profiler_, kShuffleTime);
+    order_.resize(balls_.size());
+    std::iota(order_.begin(), order_.end(), 0);
+    if (solver_ == Solver::kSequential) {
+      std::shuffle(order_.begin(), order_.end(), gen_);
+    }
+  }
+  Profiler::Scope scope(profiler_, kGridTime);
+  grid_.Build(balls_, order_);
+  gridded_ = balls_.size();
+}
+
+bool World::SweepFastBalls() {
+  // Find the balls which moved far in this tick.
+  fast_.clear();
+  for (int i = 0, n = balls_.size(); i < n; i++) {
+    const glm::vec2 d = balls_.position(i) - balls_.previous_position(i);
+    if (glm::dot(d, d) > kFastDistance * kFastDistance) fast_.push_back(i);
+  }
+
+  // Sweep each fast ball from where it started the tick, bouncing it off the
+  // first line or ball in its path and sweeping the rest of the tick from
+  // there. A ball it hits keeps its position but takes its share of the
+  // bounce. Sleeping balls are in the way too: their islands are collected in
+  // islands_, for WakeIslands() to wake. This runs on one thread, in the order
+  // of the balls, so the result does not depend on the number of threads.
+  islands_.clear();
+  bool any_moved = false;
+  for (const int i : fast_) {
+    Ball ball = balls_[i];
+    glm::vec2 p = balls_.previous_position(i);
+    glm::vec2 d = ball.position - p;
+    // The fraction of the tick which has been swept.
+    float swept = 0;
+    bool moved = false;
+    for (int bounce = 0; bounce <= kMaxBounces; bounce++) {
+      float hit = 1;
+      glm::vec2 normal;
+      int other = -1;
+      bool other_asleep = false;
+      cells_.clear();
+      line_index_.FindCells(Line{.a = p, .b = p + d}, kSweepMargin, cells_);
+      for (const BallGrid::Cell cell : cells_) {
+        for (const int l : line_index_.Find(cell)) {
+          glm::vec2 line_normal;
+          const std::optional<float> t =
+              SweepBallLine(p, d, lines_[l], line_normal);
+          if (t && *t < hit) {
+            hit = *t;
+            normal = line_normal;
+            other = -1;
+          }
+        }
+        // Sleeping balls do not move, so they are swept against as they are.
+        if (const int slot = sleeping_grid_.Find(cell); slot != -1) {
+          for (int j = sleeping_grid_.begin(slot),
+                   j_end = sleeping_grid_.end(slot);
+               j < j_end; j++) {
+            const glm::vec2 q = sleeping_.position(j);
+            const std::optional<float> t = SweepBalls(p - q, d);
+            if (t && *t < hit) {
+              hit = *t;
+              normal = glm::normalize(p - q + *t * d);
+              other = j;
+              other_asleep = true;
+            }
+          }
+        }
+        const int slot = grid_.Find(cell);
+        if (slot == -1) continue;
+        for (int j = grid_.begin(slot), j_end = grid_.end(slot); j < j_end;
+             j++) {
+          if (j == i) continue;
+          // The other ball's path over the rest of the tick.
+          const glm::vec2 start = balls_.previous_position(j);
+          const glm::vec2 q = glm::mix(start, balls_.position(j), swept);
+          const glm::vec2 e = balls_.position(j) - q;
+          const std::optional<float> t = SweepBalls(p - q, d - e);
+          if (t && *t < hit) {
+            hit = *t;
+            normal = glm::normalize(p - q + *t * (d - e));
+            other = j;
+            other_asleep = false;
+          }
+        }
+      }
+      if (hit == 1) {
+        p += d;
+        break;
+      }
+
+      // Move the ball to the contact and bounce it as the contact tests would.
+      moved = true;
+      p += hit * d;
+      if (other == -1) {
+        const float separation_speed = glm::dot(ball.velocity, normal);
+        if (separation_speed < 0) {
+          ball.velocity -= 1.8f * separation_speed * normal;
+        }
+      } else {
+        BallStore& store = other_asleep ? sleeping_ : balls_;
+        Ball b = store[other];
+        const float separation_speed =
+            glm::dot(ball.velocity - b.velocity, normal);
+        if (separation_speed < 0) {
+          const glm::vec2 correction = 0.9f * separation_speed * normal;
+          ball.velocity -= correction;
+          b.velocity += correction;
+          store.Set(other, b);
+        }
+        if (other_asleep) islands_.push_back(sleeping_.tag(other));
+      }
+      swept += hit * (1 - swept);
+      d = (1 - swept) * delta_time_ * ball.velocity;
+    }
+    if (!moved) continue;
+    ball.position = p;
+    balls_.Set(i, ball);
+    any_moved = true;
+  }
+  return any_moved;
+}
+
+bool World::WakeIslands() {
+  // Find the islands touched by awake balls, in addition to any which were hit
+  // by fast balls.
+  for (int slot = 0, n = grid_.num_cells(); slot < n; slot++) {
+    const BallGrid::Cell cell = grid_.cell(slot);
+    for (int dy = -1; dy <= 1; dy++) {
+      const BallGrid::Range row =
+          sleeping_grid_.FindRow(cell.y + dy, cell.x - 1, cell.x + 1);
+      for (int j = row.begin; j < row.end; j++) {
+        const glm::vec2 p = sleeping_.position(j);
+        for (int i = grid_.begin(slot), i_end = grid_.end(slot); i < i_end;
+             i++) {
+          if (glm::distance(balls_.position(i), p) <=
+              2 * kRadius + kSleepDrift) {
+            islands_.push_back(sleeping_.tag(j));
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  // Find the islands touched by lines which have been added or removed.
+  for (const Line& line : changed_lines_) {
+    cells_.clear();
+    line_index_.FindCells(line, cells_);
+    for (const BallGrid::Cell cell : cells_) {
+      const int slot = sleeping_grid_.Find(cell);
+      if (slot == -1) continue;
+      for (int j = sleeping_grid_.begin(slot); j < sleeping_grid_.end(slot);
+           j++) {
+        if (Distance(sleeping_.position(j), line) <= kRadius + kSleepDrift) {
+          islands_.push_back(sleeping_.tag(j));
+        }
+      }
+    }
+  }
+  changed_lines_.clear();
+  if (islands_.empty()) return false;
+
+  // Move the balls in those islands back to the awake balls.
+  std::sort(islands_.begin(), islands_.end());
+  for (int j = sleeping_.size() - 1; j >= 0; j--) {
+    if (!std::binary_search(islands_.begin(), islands_.end(),
+                            sleeping_.tag(j))) {
+      continue;
+    }
+    balls_.push_back(sleeping_[j]);
+    sleeping_.Remove(j);
+  }
+  SortSleepingBalls();
+  return true;
+}
+
+void World::Emit() {
+  // Make room for every ball owed at once, so that they are added as a batch.
+  int total = 0;
+  for (EmitterState& state : emitters_) {
+    state.owed += state.emitter.rate * delta_time_;
+    total += std::max(0, int(state.owed));
+  }
+  if (total == 0) return;
+  balls_.reserve(balls_.size() + total);
+
+  // Each emitter tries its lanes in turn, from a random one, until it has
+  // added the balls it owes or run out of lanes. A ball may only be added
+  // where it would not touch any other.
+  std::uniform_real_distribution<float> turn(-1, 1);
+  for (EmitterState& state : emitters_) {
+    const Emitter& emitter = state.emitter;
+    const int owed = state.owed;
+    if (owed <= 0) continue;
+    const float speed = glm::length(emitter.velocity);
+    const glm::vec2 across =
+        speed > 0 ? glm::vec2(-emitter.velocity.y, emitter.velocity.x) / speed
+                  : glm::vec2(1, 0);
+    const float interval =
+        std::ceil(2 * kRadius / (speed * delta_time_)) * delta_time_;
+    const int lanes = std::max(
+        1, int(std::min(std::ceil(emitter.rate * interval),
+                        float(kMaxEmitterLanes))));
+    const int start = std::uniform_int_distribution<int>(0, lanes - 1)(gen_);
+    int added = 0;
+    for (int k = 0; k < lanes && added < owed; k++) {
+      const int lane = (start + k) % lanes;
+      const glm::vec2 p = emitter.position + (lane - (lanes - 1) / 2.0f) *
+                                                 kLaneSpacing * across;
+      if (!IsClear(p)) continue;
+      const float angle = emitter.spread * turn(gen_);
+      const float c = std::cos(angle), s = std::sin(angle);
+      const glm::vec2 v = emitter.velocity;
+      balls_.push_back(Ball{
+          .position = p,
+          .velocity = glm::vec2(c * v.x - s * v.y, s * v.x + c * v.y)});
+      added++;
+    }
+    // A blocked emitter owes no more than it could add in one tick, rather
+    // than bursting when it is cleared.
+    state.owed = std::min(state.owed - added, float(lanes));
+  }
+}
+
+void World::UpdateSleep() {
+  // Count the ticks for which each ball has stayed near where it came to rest.
+  const int sleep_ticks = std::lround(kSleepSeconds * tick_rate_);
+  for (int i = 0, n = balls_.size(); i < n; i++) {
+    const glm::vec2 position = balls_.position(i);
+    if (glm::distance(position, balls_.rest_position(i)) < kRestDrift) {
+      balls_.set_tag(i, balls_.tag(i) + 1);
+    } else {
+      balls_.set_tag(i, 0);
+      balls_.set_rest_position(i, position);
+    }
+  }
+  if (--sleep_countdown_ > 0) return;
+  sleep_countdown_ = std::max(1, sleep_ticks / kSleepChecks);
+
+  // Join the balls into islands of touching balls. The grid is still valid,
+  // since the balls have moved only slightly since it was built.
+  const int n = balls_.size();
+  const auto find = [&](int i) {
+    while (parents_[i] != i) i = parents_[i] = parents_[parents_[i]];
+    return i;
+  };
+  parents_.resize(n);
+  std::iota(parents_.begin(), parents_.end(), 0);
+  for (int slot = 0, num_cells = grid_.num_cells(); slot < num_cells;
+       slot++) {
+    const BallGrid::Cell cell = grid_.cell(slot);
+    for (int i = grid_.begin(slot), i_end = grid_.end(slot); i < i_end; i++) {
+      const glm::vec2 p = balls_.position(i);
+      for (int dy = -1; dy <= 1; dy++) {
+        const BallGrid::Range row =
+            grid_.FindRow(cell.y + dy, cell.x - 1, cell.x + 1);
+        for (int j = std::max(row.begin, i + 1); j < row.end; j++) {
+          if (glm::distance(p, balls_.position(j)) <= kIslandDistance) {
+            parents_[find(i)] = find(j);
+          }
+        }
+      }
+    }
+  }
+
+  // Find the islands which have settled, marking each at its root. Sleeping
+  // balls are frozen where they are, so a single ball which is still moving
+  // keeps its whole island awake.
+  settled_.assign(n, true);
+  for (int i = 0; i < n; i++) {
+    const glm::vec2 velocity = balls_[i].velocity;
+    if (balls_.tag(i) < sleep_ticks ||
+        glm::dot(velocity, velocity) >= kSleepSpeed * kSleepSpeed) {
+      settled_[find(i)] = false;
+    }
+  }
+
+  // Put every settled island to sleep. Going backwards means that removing a
+  // ball only moves balls which have already been handled.
+  islands_.assign(n, -1);
+  bool changed = false;
+  for (int i = n - 1; i >= 0; i--) {
+    const int root = find(i);
+    if (!settled_[root]) continue;
+    if (islands_[root] == -1) islands_[root] = next_island_++;
+    sleeping_.push_back(Ball{.position = balls_.position(i)});
+    sleeping_.set_tag(sleeping_.size() - 1, islands_[root]);
+    balls_.Remove(i);
+    changed = true;
+  }
+  if (changed) {
+    gridded_ = 0;
+    SortSleepingBalls();
+  }
+}
+
+void World::Count(std::int64_t candidate_pairs, std::int64_t contacts) {
+  if (!counting_) return;
+  candidate_pairs_.fetch_add(candidate_pairs, std::memory_order_relaxed);
+  contacts_.fetch_add(contacts, std::memory_order_relaxed);
+}
+
+void World::SortSleepingBalls() {
+  sleeping_version_++;
+  order_.resize(sleeping_.size());
+  std::iota(order_.begin(), order_.end(), 0);
+  sleeping_grid_.Build(sleeping_, order_);
+}
+
+void World::CollideLines() {
+  // Check for collisions between lines and balls. Each ball is only modified
+  // by its own collisions, so every cell can be handled in parallel.
+  //
+  // Where segments meet at a shared end, a ball near the joint touches both,
+  // and colliding with each as if it were alone would push the ball twice,
+  // or push it back from the joint as it rolls across. So a ball never
+  // collides with an end which it touches through more than one segment, or
+  // which belongs to a segment whose interior it touches, more than once.
+  //
+  // A ball pressed hard against a line, or moving fast, can end up with its
+  // center across the line, where it would be pushed the rest of the way
+  // through. So a ball is always pushed back to the side of a line that it
+  // started the tick on.
+  constexpr int kMaxEnds = 16;
+  const int num_cells = grid_.num_cells();
+  cell_lines_.resize(num_cells);
+  pool_.ParallelFor((num_cells + kChunkSize - 1) / kChunkSize, [&](int chunk) {
+    glm::vec2 ends[kMaxEnds];
+    const int end = std::min(num_cells, (chunk + 1) * kChunkSize);
+    for (int slot = chunk * kChunkSize; slot < end; slot++) {
+      const std::span<const int> lines = line_index_.Find(grid_.cell(slot));
+      cell_lines_[slot] = lines;
+      if (lines.empty()) continue;
+      for (int i = grid_.begin(slot), i_end = grid_.end(slot); i < i_end;
+           i++) {
+        Ball ball = balls_[i];
+        // Find the ends of the segments whose interior the ball touches.
+        int num_ends = 0;
+        glm::vec2 closest;
+        if (lines.size() > 1) {
+          for (int l : lines) {
+            const Line& line = lines_[l];
+            if (num_ends + 2 <= kMaxEnds &&
+                FindTouch(ball.position, line, closest) == Touch::kInterior) {
+              ends[num_ends++] = line.a;
+              ends[num_ends++] = line.b;
+            }
+          }
+        }
+        const glm::vec2 start = balls_.previous_position(i);
+        for (int l : lines) {
+          const Line& line = lines_[l];
+          const Touch touch = FindTouch(ball.position, line, closest);
+          if (touch == Touch::kNone) continue;
+          if (touch == Touch::kEnd) {
+            if (std::find(ends, ends + num_ends, closest) != ends + num_ends) {
+              continue;
+            }
+            if (num_ends < kMaxEnds) ends[num_ends++] = closest;
+          }
+          glm::vec2 normal;
+          if (touch == Touch::kInterior) {
+            // Push the ball out on the side it started on, in case its center
+            // has crossed the line.
+            const glm::vec2 d = line.b - line.a;
+            float side = Cross(d, start - line.a);
+            if (side == 0) side = Cross(d, ball.position - line.a);
+            normal = glm::normalize(glm::vec2(-d.y, d.x));
+            if (side < 0) normal = -normal;
+          } else {
+            normal = glm::normalize(ball.position - closest);
+          }
+          CollideBallLine(ball, closest, normal);
+        }
+        balls_.Set(i, ball);
+      }
+    }
+  });
+}
+
+void World::UncrossLines() {
+  // A line which a ball's path crosses comes within kRadius of every cell
+  // whose margin of kRadius holds the whole path, so it is listed in that cell.
+  // That is the cell the ball was sorted into for all but the balls which
+  // moved furthest, which look in every cell their path passes through.
+  const int num_cells = grid_.num_cells();
+  pool_.ParallelFor((num_cells + kChunkSize - 1) / kChunkSize, [&](int chunk) {
+    std::vector<BallGrid::Cell> cells;
+    const int end = std::min(num_cells, (chunk + 1) * kChunkSize);
+    for (int slot = chunk * kChunkSize; slot < end; slot++) {
+      const BallGrid::Cell cell = grid_.cell(slot);
+      const std::span<const int> cell_lines = cell_lines_[slot];
+      const glm::vec2 min =
+          glm::vec2(cell.x, cell.y) * kCellSize - glm::vec2(kRadius);
+      const glm::vec2 max = min + glm::vec2(kCellSize + 2 * kRadius);
+      const auto inside = [&](glm::vec2 p) {
+        return p.x >= min.x && p.y >= min.y && p.x <= max.x && p.y <= max.y;
+      };
+      for (int i = grid_.begin(slot), i_end = grid_.end(slot); i < i_end;
+           i++) {
+        const glm::vec2 start = balls_.previous_position(i);
+        glm::vec2 position = balls_.position(i);
+        cells.clear();
+        if (inside(start) && inside(position)) {
+          if (cell_lines.empty()) continue;
+          cells.push_back(cell);
+        } else {
+          line_index_.FindCells(Line{.a = start, .b = position}, 0, cells);
+        }
+
+        // Putting the ball back across one line can move it across another
+        // where they meet, so this repeats until it crosses none.
+        std::optional<Ball> ball;
+        for (int pass = 0; pass < kMaxBounces; pass++) {
+          bool crossed = false;
+          for (const BallGrid::Cell c : cells) {
+            const std::span<const int> lines =
+                c == cell ? cell_lines : line_index_.Find(c);
+            for (const int l : lines) {
+              const Line& line = lines_[l];
+              glm::vec2 normal;
+              if (!CrossesLine(start, position - start, line, normal)) {
+                continue;
+              }
+              // Put the ball back in contact with the line, and bounce it.
+              if (!ball) ball = balls_[i];
+              ball->position +=
+                  (kRadius - glm::dot(ball->position - line.a, normal)) *
+                  normal;
+              position = ball->position;
+              const float separation_speed = glm::dot(ball->velocity, normal);
+              if (separation_speed < 0) {
+                ball->velocity -= 1.8f * separation_speed * normal;
+              }
+              crossed = true;
+            }
+          }
+          if (!crossed) break;
+        }
+        if (ball) balls_.Set(i, *ball);
+      }
+    }
+  });
+}
+
+void World::SolveSequential() {
+  // Split the occupied cells into 9 interleaved groups according to their
+  // position modulo 3 in each axis. Resolving the collisions for the balls in
+  // one cell touches only the 3x3 block of cells around it, so the cells in
+  // each group can be handled in parallel without any two threads touching
+  // the same ball.
+  for (std::vector<int>& group : groups_) group.clear();
+  for (int slot = 0, n = grid_.num_cells(); slot < n; slot++) {
+    const BallGrid::Cell cell = grid_.cell(slot);
+    const int x = (cell.x % 3 + 3) % 3, y = (cell.y % 3 + 3) % 3;
+    groups_[y * 3 + x].push_back(slot);
+  }
+
+  // Check for collisions between balls, one group of cells at a time. Since
+  // the balls are sorted by cell, the balls in each row of the 3x3 block
+  // around a cell are contiguous and can be tested several at a time. The
+  // test is widened slightly so that it still finds balls which are pushed
+  // into contact while the ball's earlier collisions are resolved;
+  // CollideBalls() makes the exact test.
+  constexpr float kSearchRadius = 2.5f * kRadius;
+  for (const std::vector<int>& group : groups_) {
+    const int n = group.size();
+    pool_.ParallelFor((n + kChunkSize - 1) / kChunkSize, [&](int chunk) {
+      int hits[kBatchSize];
+      std::int64_t candidate_pairs = 0, contacts = 0;
+      const int end = std::min(n, (chunk + 1) * kChunkSize);
+      for (int j = chunk * kChunkSize; j < end; j++) {
+        const int slot = group[j];
+        const BallGrid::Cell cell = grid_.cell(slot);
+        BallGrid::Range rows[3];
+        for (int dy = -1; dy <= 1; dy++) {
+          rows[dy + 1] = grid_.FindRow(cell.y + dy, cell.x - 1, cell.x + 1);
+        }
+        for (int i = grid_.begin(slot), i_end = grid_.end(slot); i < i_end;
+             i++) {
+          Ball a = balls_[i];
+          for (const BallGrid::Range& row : rows) {
+            for (int first = row.begin; first < row.end; first += kBatchSize) {
+              const int num_hits = FindBallsNear(
+                  a.position, balls_.x() + first, balls_.y() + first,
+                  std::min(kBatchSize, row.end - first),
+                  kSearchRadius * kSearchRadius, hits);
+              for (int k = 0; k < num_hits; k++) {
+                const int other = first + hits[k];
+                if (other == i) continue;
+                candidate_pairs++;
+                Ball b = balls_[other];
+                if (CollideBalls(a, b)) {
+                  balls_.Set(other, b);
+                  contacts++;
+                }
+              }
+            }
+          }
+          balls_.Set(i, a);
+        }
+      }
+      Count(candidate_pairs, contacts);
+    });
+  }
+}
+
+void World::SolveJacobi() {
+  const int num_balls = balls_.size();
+  position_corrections_.resize(num_balls);
+  velocity_corrections_.resize(num_balls);
+  for (int iteration = 0; iteration < kJacobiIterations; iteration++) {
+    SolveJacobiIteration();
+  }
+}
+
+void World::SolveJacobiIteration() {
+  // Sum the corrections for each ball from all of its contacts. Every ball
+  // only reads the others and writes its own corrections, so all cells can be
+  // handled in parallel.
+  const int num_balls = balls_.size();
+  const int num_cells = grid_.num_cells();
+  pool_.ParallelFor((num_cells + kChunkSize - 1) / kChunkSize, [&](int chunk) {
+    int hits[kBatchSize];
+    std::int64_t candidate_pairs = 0, contacts = 0;
+    const int end = std::min(num_cells, (chunk + 1) * kChunkSize);
+    for (int slot = chunk * kChunkSize; slot < end; slot++) {
+      const BallGrid::Cell cell = grid_.cell(slot);
+      BallGrid::Range rows[3];
+      for (int dy = -1; dy <= 1; dy++) {
+        rows[dy + 1] = grid_.FindRow(cell.y + dy, cell.x - 1, cell.x + 1);
+      }
+      for (int i = grid_.begin(slot), i_end = grid_.end(slot); i < i_end;
+           i++) {
+        const Ball a = balls_[i];
+        glm::vec2 position_correction = glm::vec2();
+        glm::vec2 velocity_correction = glm::vec2();
+        for (const BallGrid::Range& row : rows) {
+          for (int first = row.begin; first < row.end; first += kBatchSize) {
+            const int num_hits = FindBallsNear(
+                a.position, balls_.x() + first, balls_.y() + first,
+                std::min(kBatchSize, row.end - first),
+                4 * kRadius * kRadius, hits);
+            for (int k = 0; k < num_hits; k++) {
+              const int other = first + hits[k];
+              if (other == i) continue;
+              candidate_pairs++;
+              contacts += AddContact(a, balls_[other], i < other,
+                                     position_correction, velocity_correction);
+            }
+          }
+        }
+        position_corrections_[i] = kJacobiRelaxation * position_correction;
+        velocity_corrections_[i] = kJacobiRelaxation * velocity_correction;
+      }
+    }
+    Count(candidate_pairs, contacts);
+  });
+
+  // Apply the corrections.
+  pool_.ParallelFor((num_balls + kChunkSize - 1) / kChunkSize, [&](int chunk) {
+    const int end = std::min(num_balls, (chunk + 1) * kChunkSize);
+    for (int i = chunk * kChunkSize; i < end; i++) {
+      balls_.x()[i] += position_corrections_[i].x;
+      balls_.y()[i] += position_corrections_[i].y;
+      balls_.vx()[i] += velocity_corrections_[i].x;
+      balls_.vy()[i] += velocity_corrections_[i].y;
+    }
+  });
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "ball_grid.h"
+#include "ball_store.h"
+#include "line_index.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+constexpr float kRadius = 1.0f;  // Currently hard-coded in the shader.
+constexpr int kDefaultTickRate = 240;
+constexpr glm::vec2 kGravity = glm::vec2(0, 50);
+
+// How contacts between balls are resolved.
+enum class Solver {
+  // Contacts are resolved one at a time, each seeing the effect of the ones
+  // before it. The result depends on the order, so the balls are shuffled
+  // whenever they are sorted into the grid to avoid any bias.
+  kSequential,
+  // Every contact is evaluated against the positions and velocities from the
+  // start of an iteration, and the corrections for each ball are summed and
+  // applied together afterwards. Each contact pass runs a few such damped
+  // iterations. The result does not depend on the order, so the balls keep
+  // their spatial order and no shuffle is needed.
+  kJacobi,
+};
+
+// The metrics which World::Update() records when it has a profiler, with one
+// frame per tick.
+enum WorldMetric {
+  kIntegrateTime,
+  kKillTime,
+  kShuffleTime,
+  kGridTime,
+  kSweepTime,
+  kWakeTime,
+  kLineContactTime,
+  kBallContactTime,
+  kUncrossTime,
+  kEmitTime,
+  kSleepTime,
+  kCandidatePairs,
+  kContacts,
+  kAwakeBalls,
+  kFastBalls,
+};
+inline constexpr Profiler::Metric kWorldMetrics[] = {
+    {"integrate", Profiler::Kind::kTime},
+    {"kill", Profiler::Kind::kTime},
+    {"shuffle", Profiler::Kind::kTime},
+    {"grid", Profiler::Kind::kTime},
+    {"sweep", Profiler::Kind::kTime},
+    {"wake", Profiler::Kind::kTime},
+    {"line_contacts", Profiler::Kind::kTime},
+    {"ball_contacts", Profiler::Kind::kTime},
+    {"uncross", Profiler::Kind::kTime},
+    {"emit", Profiler::Kind::kTime},
+    {"sleep", Profiler::Kind::kTime},
+    {"candidate_pairs", Profiler::Kind::kCount},
+    {"contacts", Profiler::Kind::kCount},
+    {"awake_balls", Profiler::Kind::kCount},
+    {"fast_balls", Profiler::Kind::kCount},
+};
+
+// A source of a steady stream of balls. Each ball leaves from one of a row of
+// lanes across the emitter, wide enough for the rate at the given speed, and
+// only once no other ball is in the way. A lane adds a ball on the first tick
+// after the last one has moved 2 * kRadius away, and there are at most
+// kMaxEmitterLanes of them, which caps the rate. At a speed of 80, that is
+// 2560 balls per second at the default tick rate and 1920 at 60 ticks.
+constexpr int kMaxEmitterLanes = 64;
+struct Emitter {
+  glm::vec2 position;
+  // The velocity of the balls emitted, before the spread is applied.
+  glm::vec2 velocity;
+  // The number of balls emitted per second of simulated time, up to the cap
+  // set by kMaxEmitterLanes.
+  float rate;
+  // The largest angle, in radians, by which a ball's direction is turned from
+  // that of velocity, chosen uniformly at random.
+  float spread;
+};
+
+struct WorldOptions {
+  std::uint32_t seed = 0;
+  // The number of ticks per second of simulated time, which must be positive.
+  // Each tick integrates the balls and rebuilds the grid once. At lower rates
+  // than kDefaultTickRate, the contacts are resolved over a few passes within
+  // the tick, but they are still softer: below about 120 ticks per second, the
+  // balls at the bottom of a deep pile can be pressed almost on top of each
+  // other. Balls which move far in one tick are swept along their path, so
+  // they do not pass through lines or other balls.
+  int tick_rate = kDefaultTickRate;
+  // The number of threads used to resolve collisions, including the thread
+  // which calls World::Update(). The results do not depend on this.
+  int threads = 1;
+  // If set, balls which move further than this from the origin are removed.
+  std::optional<float> kill_radius;
+  Solver solver = Solver::kSequential;
+  // If set, groups of touching balls which have come to rest are put to
+  // sleep, and cost nothing until something touches them.
+  bool sleep = false;
+  // If set, Update() records kWorldMetrics to this while it is enabled. It
+  // must outlive the world.
+  Profiler* profiler = nullptr;
+};
+
+// The simulated world: a set of balls falling under gravity and bouncing off
+// each other and off a set of static lines. This has no dependency on any
+// windowing or rendering code so that it can be driven headlessly.
+class World {
+ public:
+  explicit World(const WorldOptions& options);
+
+  // Advance the simulation by delta_time().
+  void Update();
+
+  int tick_rate() const { return tick_rate_; }
+  float delta_time() const { return delta_time_; }
+
+  // New balls are always awake. Like the emitters, a ball is only added if it
+  // would not touch any other ball, since the contact solver would throw the
+  // two apart at speed. Returns whether it was added.
+  bool AddBall(const Ball& ball);
+  // Adds a batch of balls, making room for all of them at once. Returns the
+  // number which were added.
+  int AddBalls(std::span<const Ball> balls);
+  // Emitters add their balls at the end of each tick.
+  void AddEmitter(const Emitter& emitter);
+  void AddLine(const Line& line);
+  // Removes line i by moving the last line into its place.
+  void RemoveLine(int i);
+
+  // The awake balls and the sleeping balls. Together they make up every ball
+  // in the world.
+  const BallStore& balls() const { return balls_; }
+  const BallStore& sleeping_balls() const { return sleeping_; }
+  std::span<const Line> lines() const { return lines_; }
+  // Changes whenever existing lines are changed or removed, but not when new
+  // lines are added to the end.
+  std::uint64_t lines_version() const { return lines_version_; }
+  // Changes whenever balls fall asleep or wake, which are the only times the
+  // sleeping balls change.
+  std::uint64_t sleeping_version() const { return sleeping_version_; }
+
+  // Writes the complete state of the world to a scene file, such that a world
+  // with the same options which loads it continues exactly as this one would.
+  // The options themselves are not saved. Returns false if the file could not
+  // be written.
+  bool Save(const std::filesystem::path& path) const;
+  // Replaces the state of the world with that from a scene file. Returns
+  // false, leaving the world unchanged, if the file could not be read or is
+  // not a scene file written by a compatible version on a machine with the
+  // same byte order.
+  bool Load(const std::filesystem::path& path);
+
+  // Returns a hash of the complete state of the world, for checking whether
+  // two runs reached exactly the same state.
+  std::uint64_t Fingerprint() const;
+
+ private:
+  void SortBalls();
+  // Moves each ball which moved far in this tick back to where its path first
+  // meets a line or another ball, and bounces it from there. Returns true if
+  // any balls were moved.
+  bool SweepFastBalls();
+  // Returns true if any islands were woken.
+  bool WakeIslands();
+  void CollideLines();
+  // Moves each ball whose center crossed a line during the tick back to the
+  // side it started on.
+  void UncrossLines();
+  void SolveSequential();
+  void SolveJacobi();
+  void SolveJacobiIteration();
+  // Returns true if a ball at p would not touch any other ball.
+  bool IsClear(glm::vec2 p) const;
+  // Adds the balls which the emitters owe, wherever there is room.
+  void Emit();
+  void UpdateSleep();
+  void SortSleepingBalls();
+  // Adds to the counts for the profiler.
+  void Count(std::int64_t candidate_pairs, std::int64_t contacts);
+
+  std::ranlux24 gen_;
+  ThreadPool pool_;
+  const int tick_rate_;
+  const float delta_time_;
+  const int contact_passes_;
+  const std::optional<float> kill_radius_;
+  const Solver solver_;
+  const bool sleep_;
+  Profiler* const profiler_;
+  BallStore balls_;
+  std::vector<int> order_;
+  std::vector<Line> lines_;
+  std::uint64_t lines_version_ = 0;
+  // Each emitter, with the number of balls it owes, which builds up at its
+  // rate and is paid off as it adds balls.
+  struct EmitterState {
+    Emitter emitter;
+    float owed = 0;
+  };
+  std::vector<EmitterState> emitters_;
+  BallGrid grid_;
+  // The number of balls at the start of balls_ which are in grid_, or 0 if
+  // balls have been removed since it was built. Balls added since come after
+  // them.
+  int gridded_ = 0;
+  LineIndex line_index_;
+
+  // The slots of the occupied cells, split into groups which can be processed
+  // in parallel.
+  std::array<std::vector<int>, 9> groups_;
+
+  // Sleeping balls, grouped into islands of touching balls which sleep and
+  // wake together. Each sleeping ball's tag is the id of its island, and each
+  // awake ball's tag is the number of ticks it has been at rest. The awake
+  // islands are only checked every few ticks, counted down by
+  // sleep_countdown_. Sleeping balls are in their own grid, which is only
+  // rebuilt when they change.
+  BallStore sleeping_;
+  BallGrid sleeping_grid_;
+  std::uint64_t sleeping_version_ = 0;
+  int next_island_ = 0;
+  int sleep_countdown_ = 0;
+  // Lines which have been added or removed since the last tick, which wake
+  // any islands they touch.
+  std::vector<Line> changed_lines_;
+  // Scratch space for waking and forming islands.
+  std::vector<int> islands_, parents_;
+  std::vector<char> settled_;
+  std::vector<BallGrid::Cell> cells_;
+  // Scratch space for sweeping fast balls.
+  std::vector<int> fast_;
+  // The lines listed for each occupied cell, found by CollideLines() and
+  // reused by UncrossLines().
+  std::vector<std::span<const int>> cell_lines_;
+
+  // Counts for the profiler, which are only collected while it is enabled.
+  bool counting_ = false;
+  std::atomic<std::int64_t> candidate_pairs_ = 0, contacts_ = 0;
+
+  // The summed corrections for each ball, used by the Jacobi solver.
+  std::vector<glm::vec2> position_corrections_, velocity_corrections_;
+};